@@ -51,7 +51,15 @@ void Args::printHelp() {
 -uid <unique_id>   : specifies to use the GPU with the given unique_id (only on ROCm/Linux)
 -user <name>       : specify the user name.
 -cpu  <name>       : specify the hardware name.
--time              : display kernel profiling information.
+-time              : display kernel profiling information, with the achieved GB/s (and %% of the measured copy
+                     bandwidth) and GFLOP/s of the main kernels.
+-peakFlops <GFLOP/s> : the FP64 peak of the GPU; with -time, marks each kernel as memory or compute bound.
+-timeSample <K>    : profile on average one in every <K> windows of kernel launches, at random offsets so that every
+                     kernel gets sampled, and show the per-kernel times (mean and 95%% confidence interval, in us)
+                     on the progress lines. Cheap enough to leave on.
+-trace [<iters>]   : write a timeline of the GPU kernels and of the host work (checks, reads, saves, GCDs) of the
+                     first <iters> iterations (default 10000) of a run to <exponent>/trace-<k>.json.
+                     Open it in chrome://tracing or ui.perfetto.dev.
 -fft <spec>        : specify FFT e.g.: 1152K, 5M, 5.5M, 256:10:1K
 -block <value>     : PRP error-check block size. Must divide 10'000.
 -log <step>        : log every <step> iterations. Multiple of 10'000.
@@ -61,6 +69,16 @@ void Args::printHelp() {
 -rB2               : ratio of B2 to B1. Default %u, used only if B2 is not explicitly set
 -prp <exponent>    : run a single PRP test and exit, ignoring worktodo.txt
 -verify <file>     : verify PRP-proof contained in <file>
+-benchHost <exponent> : measure the host overhead of enqueueing the squaring iterations, and exit
+-calibrate <fft>|all : measure the roundoff of the FFT configs of the given spec or size (or all) around their
+                     max exponent, and store the fitted crossovers in the cache folder, where they replace the
+                     built-in limits on this device. Runs -iters iterations (default 20000) per exponent.
+-tune <exponent>   : benchmark the FFT variants and the -use tuning options for the exponent's FFT size, and store
+                     the fastest in the cache folder, where it is used for that FFT size unless -fft is given.
+-bench <list>      : time the squaring loop, modMul, exponentiate, fold and the residue transfers, with the per-kernel
+                     times, for each of the comma separated FFT specs (e.g. 5M or 1K:10:256) or exponents; -iters sets
+                     the number of squarings (default 10000).
+-benchOut <file>   : write the -bench results to <file>, as JSON if it ends in .json, CSV otherwise.
 -proof <power>     : By default a proof of power 8 is generated, using 3GB of temporary disk space for a 100M exponent.
                      A lower power reduces disk space requirements but increases the verification cost.
                      A proof of power 9 uses 6GB of disk space for a 100M exponent and enables faster verification.
@@ -78,6 +96,9 @@ void Args::printHelp() {
 -use NEW_FFT8,OLD_FFT5,NEW_FFT10: comma separated list of defines, see the #if tests in gpuowl.cl (used for perf tuning)
 -unsafeMath        : use OpenCL -cl-unsafe-math-optimizations (use at your own risk)
 -binary <file>     : specify a file containing the compiled kernels binary
+-cache <dir>       : folder where the compiled kernels and the trig/weights tables are cached,
+                     default 'kernel-cache' (shared in -pool dir)
+-nocache           : do not use the kernels and tables cache
 -device <N>        : select a specific device:
 )", B2_B1_ratio);
 
@@ -180,6 +201,12 @@ void Args::parse(const string& line) {
     else if (key == "-log") { logStep = stoi(s); assert(logStep && (logStep % 10000 == 0)); }
     else if (key == "-iters") { iters = stoi(s); assert(iters && (iters % 10000 == 0)); }
     else if (key == "-prp" || key == "-PRP") { prpExp = stoll(s); }
+    else if (key == "-benchHost") { benchHostExp = stoll(s); }
+    else if (key == "-calibrate") { calibrate = s; }
+    else if (key == "-tune") { tuneExp = stoll(s); }
+    else if (key == "-bench") { bench = s; }
+    else if (key == "-benchOut") { benchOut = s; }
+    else if (key == "-peakFlops") { peakFlops = stoi(s); }
     else if (key == "-B1" || key == "-b1") { B1 = stoi(s); }
     else if (key == "-B2" || key == "-b2") { B2 = stoi(s); }
     else if (key == "-rB2") { B2_B1_ratio = stoi(s); }
@@ -188,6 +215,14 @@ void Args::parse(const string& line) {
     else if (key == "-user") { user = s; }
     else if (key == "-cpu") { cpu = s; }
     else if (key == "-time") { timeKernels = true; }
+    else if (key == "-timeSample") { timeSample = stoi(s); }
+    else if (key == "-trace") {
+      trace = s.empty() ? 10000 : stoi(s);
+      if (!trace) {
+        log("-trace expects <iters> > 0\n");
+        throw "-trace <iters>";
+      }
+    }
     else if (key == "-device" || key == "-d") { device = stoi(s); }
     else if (key == "-uid") { device = getSeqId(s); }
     else if (key == "-dir") { dir = s; }
@@ -215,6 +250,14 @@ void Args::parse(const string& line) {
       safeMath = false;
     } else if (key == "-binary") {
       binaryFile = s;
+    } else if (key == "-cache") {
+      if (s.empty()) {
+        log("-cache needs <dir>\n");
+        throw "-cache needs <dir>";
+      }
+      cacheDir = s;
+    } else if (key == "-nocache") {
+      useCache = false;
     } else if (key == "-save") {
       nSavefiles = stoi(s);      
     } else if (key == "-from") {
@@ -246,10 +289,12 @@ void Args::setDefaults() {
     if (proofResultDir.is_relative()) { proofResultDir = masterDir / proofResultDir; }
     if (proofToVerifyDir.is_relative()) { proofToVerifyDir = masterDir / proofToVerifyDir; }
     if (resultsFile.is_relative()) { resultsFile = masterDir / resultsFile; }
+    if (cacheDir.is_relative()) { cacheDir = masterDir / cacheDir; }
   }
 
   fs::create_directory(proofResultDir);
   fs::create_directory(proofToVerifyDir);
+  if (useCache) { fs::create_directory(cacheDir); }
 
   if (!fs::exists(tmpDir)) {
     log("The tmpDir '%s' does not exist\n", tmpDir.string().c_str());
@@ -33,6 +33,8 @@ public:
   int device = 0;
   
   bool timeKernels = false;
+  u32 timeSample = 0;
+  u32 trace = 0; // the number of iterations to trace, 0 for none
   bool cudaYield = false;
   bool noSpin = false;
   bool safeMath = true;
@@ -46,6 +48,8 @@ public:
   fs::path tmpDir = ".";
   fs::path proofResultDir = "proof";
   fs::path proofToVerifyDir = "proof-tmp";
+  fs::path cacheDir = "kernel-cache";
+  bool useCache = true;
   
   bool keepProof = false;
 
@@ -60,6 +64,12 @@ public:
   u32 D = 0;
   
   u32 prpExp = 0;
+  u32 benchHostExp = 0;
+  string calibrate;
+  u32 tuneExp = 0;
+  string bench;
+  fs::path benchOut;
+  u32 peakFlops = 0; // GFLOP/s, FP64
   
   size_t maxAlloc = 0;
 
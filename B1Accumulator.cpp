@@ -10,8 +10,9 @@
 
 #include <tuple>
 
-B1Accumulator::B1Accumulator(Gpu* gpu, Saver* saver, u32 E)
-  : E{E}, b1{saver->b1}, nBits{powerSmoothBits(E, b1)}, gpu{gpu}, saver{saver}, N{gpu->getFFTSize()} {
+B1Accumulator::B1Accumulator(Gpu* gpu, Saver* saver, u32 E, vector<bool>&& bits)
+  : E{E}, b1{saver->b1}, nBits{bits.empty() ? powerSmoothBits(E, b1) : u32(bits.size())},
+    gpu{gpu}, saver{saver}, N{gpu->getFFTSize()}, bits{std::move(bits)} {
   log("P1(%s) %u bits\n", formatBound(b1).c_str(), nBits);
 }
 
@@ -84,7 +85,7 @@ vector<u32> B1Accumulator::save(u32 k) {
 
       saver->saveP1(k, {nextK, data});
       if (nextK == 0) {
-        saver->saveP1Final(data);
+        saver->saveP1Final(k, Words{data});
         release();
       }
       return data;
@@ -7,6 +7,7 @@
 #include "common.h"
 
 #include <cassert>
+#include <optional>
 
 class Gpu;
 class Args;
@@ -39,7 +40,8 @@ private:
   void verifyRoundtrip(const Words& expected);
   
 public:
-  B1Accumulator(Gpu* gpu, Saver* saver, u32 E);
+  // "bits", if not empty, is the precomputed powerSmoothLSB(E, b1).
+  B1Accumulator(Gpu* gpu, Saver* saver, u32 E, vector<bool>&& bits = {});
   ~B1Accumulator() { release(); }
 
   u32 wantK() const { return nextK; }
@@ -0,0 +1,59 @@
+// Copyright (C) Mihai Preda.
+
+#include "Bench.h"
+#include "File.h"
+#include "version.h"
+
+#include <cstdio>
+
+namespace {
+
+// A JSON string literal, quotes included.
+string jsonString(const string& s) {
+  string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (u8(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", u32(c));
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + '"';
+}
+
+// A quoted CSV field, with the quotes inside doubled (RFC 4180).
+string csvField(const string& s) {
+  string out = "\"";
+  for (char c : s) {
+    if (c == '"') { out += '"'; }
+    out += c;
+  }
+  return out + '"';
+}
+
+}
+
+void writeBench(const fs::path& file, const string& device, const vector<BenchResult>& results) {
+  File fo = File::openWrite(file);
+  if (file.extension() == ".json") {
+    fo.printf("{\"version\": %s, \"device\": %s, \"results\": [\n", jsonString(VERSION).c_str(), jsonString(device).c_str());
+    for (u32 i = 0; i < results.size(); ++i) {
+      const BenchResult& r = results[i];
+      fo.printf("  {\"fft\": %s, \"exponent\": %u, \"what\": %s, \"calls\": %u, \"usPerCall\": %.3f, \"GBps\": %.2f}%s\n",
+                jsonString(r.fft).c_str(), r.E, jsonString(r.what).c_str(), r.calls, r.usPerCall, r.gbps, i + 1 < results.size() ? "," : "");
+    }
+    fo.printf("]}\n");
+  } else {
+    fo.printf("version,device,fft,exponent,what,calls,usPerCall,GBps\n");
+    for (const BenchResult& r : results) {
+      fo.printf("%s,%s,%s,%u,%s,%u,%.3f,%.2f\n",
+                csvField(VERSION).c_str(), csvField(device).c_str(), csvField(r.fft).c_str(), r.E, csvField(r.what).c_str(), r.calls, r.usPerCall, r.gbps);
+    }
+  }
+  log("Wrote %u results to '%s'\n", u32(results.size()), file.string().c_str());
+}
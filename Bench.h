@@ -0,0 +1,23 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// One measurement of -bench: an operation, or one kernel within an operation ("op/kernel").
+struct BenchResult {
+  string fft;
+  u32 E{};
+  string what;
+  u32 calls{};
+  double usPerCall{};
+  double gbps{}; // achieved memory (or, for the host transfers, bus) bandwidth; 0 if not estimated
+};
+
+// JSON if the file name ends in ".json", CSV otherwise. The device is a description of the GPU and driver.
+void writeBench(const fs::path& file, const string& device, const vector<BenchResult>& results);
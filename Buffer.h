@@ -7,13 +7,18 @@
 #include "Context.h"
 #include "Queue.h"
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
 
+// The source of the buffer ids, which are unique over the process unlike the cl_mem handles.
+inline std::atomic<u64> nextBufferId{1};
+
 template<typename T>
 class ConstBuffer {
   std::unique_ptr<cl_mem> ptr;
+  u64 uid; // identifies the allocation held in ptr; the driver may give a released cl_mem to a new one
   
 public:
   const size_t size{};
@@ -25,6 +30,7 @@ private:
 protected:
   ConstBuffer(cl_context context, std::string_view name, unsigned kind, size_t size, const T* ptr = nullptr)
     : ptr{makeBuf_(context, kind, size * sizeof(T), ptr)}
+    , uid{nextBufferId++}
     , size(size)
     , name(name)
     , allocTrac(size * sizeof(T))
@@ -48,12 +54,14 @@ public:
   ConstBuffer& operator=(ConstBuffer&& rhs) {
     assert(size == rhs.size);
     ptr = std::move(rhs.ptr);
+    uid = rhs.uid;
     return *this;
   }
   
   virtual ~ConstBuffer() = default;
   
   cl_mem get() const { return ptr.get(); }
+  u64 id() const { return uid; }
   void reset() { ptr.reset(); }
 };
 
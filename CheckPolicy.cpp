@@ -0,0 +1,72 @@
+// Copyright (C) Mihai Preda.
+
+#include "CheckPolicy.h"
+#include "File.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+// As if 1 error was seen in 100M iterations.
+constexpr const double PRIOR_ERRORS = 1;
+constexpr const double PRIOR_ITERS = 1e8;
+
+// The weight of old observations halves every this many iterations.
+constexpr const double HALF_LIFE = 2e9;
+
+constexpr const u32 MIN_STEP = 20'000;
+// The savefiles are written at the checks, so this also bounds the work lost to a crash or a power loss,
+// which the error rate doesn't account for.
+constexpr const u32 MAX_STEP = 500'000;
+constexpr const u32 DEFAULT_STEP = 200'000;
+
+}
+
+CheckPolicy::CheckPolicy(const fs::path& file) : file{file} {
+  if (file.empty()) { return; }
+  if (File fi = File::openRead(file)) {
+    if (fi.scanf("%lf %lf %lf", &errors, &iters, &overheadIts) != 3 || errors < 0 || iters < 0 || overheadIts < 0) {
+      log("%s: ignoring bad content\n", fi.name.c_str());
+      errors = iters = overheadIts = 0;
+    }
+  }
+}
+
+void CheckPolicy::save() const {
+  if (file.empty()) { return; }
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%.3f %.0f %.1f\n", errors, iters, overheadIts);
+  File::replace(file, buf);
+}
+
+void CheckPolicy::checked(u32 its, bool ok, float secsPerIt, float secsCheck, float secsSave) {
+  double decay = std::exp2(-(its / HALF_LIFE));
+  errors = errors * decay + !ok;
+  iters = iters * decay + its;
+
+  if (ok && secsPerIt > 0) {
+    double cost = (secsCheck + secsSave) / secsPerIt;
+    overheadIts = overheadIts ? 0.8 * overheadIts + 0.2 * cost : cost;
+  }
+  save();
+}
+
+double CheckPolicy::errorRate() const { return (errors + PRIOR_ERRORS) / (iters + PRIOR_ITERS); }
+
+u32 CheckPolicy::checkStep() const {
+  if (!overheadIts) { return DEFAULT_STEP; }
+
+  double step = std::sqrt(2 * overheadIts / errorRate());
+  return std::clamp(u32(step / 10000 + 0.5) * 10000, MIN_STEP, MAX_STEP);
+}
+
+u32 CheckPolicy::blockSize(u32 checkStep) {
+  // Overhead per iteration: 1/B for the block multiplications, B/checkStep for the check. Minimal at B = sqrt(checkStep).
+  double best = std::sqrt(double(checkStep));
+  u32 ret = 0;
+  for (u32 b : {100u, 125u, 200u, 250u, 400u, 500u, 625u, 1000u}) {
+    if (!ret || std::abs(std::log(b / best)) < std::abs(std::log(ret / best))) { ret = b; }
+  }
+  return ret;
+}
@@ -0,0 +1,40 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Chooses the spacing of the Gerbicz checks: the one that minimizes the check+save overhead plus the expected work
+// lost to errors, for the error rate observed on this device (Young's formula, step = sqrt(2 * overhead / rate)).
+// Both the error rate and the cost of a check are learned over the runs on the device and kept in a small text file.
+class CheckPolicy {
+  const fs::path file; // empty: not persisted
+
+  // The errors seen and the iterations covered by checks, both exponentially decayed.
+  double errors = 0;
+  double iters = 0;
+
+  // Running average of the check+save time, in iterations; 0 if not measured yet.
+  double overheadIts = 0;
+
+  void save() const;
+
+public:
+  explicit CheckPolicy(const fs::path& file);
+
+  // Called after a check covering "its" iterations; the timings are used only when the check was OK.
+  void checked(u32 its, bool ok, float secsPerIt, float secsCheck, float secsSave);
+
+  // Errors per iteration, with a prior for the devices that have not seen many iterations yet.
+  double errorRate() const;
+
+  // A multiple of 10000.
+  u32 checkStep() const;
+
+  // The divisor of 10000 balancing the per-block multiplications against the check's blockSize squarings.
+  static u32 blockSize(u32 checkStep);
+};
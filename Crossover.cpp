@@ -0,0 +1,105 @@
+// Copyright (C) Mihai Preda.
+
+#include "Crossover.h"
+#include "FFTConfig.h"
+#include "File.h"
+
+#include <cmath>
+
+double RoundoffStats::pErr(u32 E, double mean, double sd) {
+  double gamma = 0.577215665; // Euler-Mascheroni
+  double z = (0.5 - mean) / sd;
+  return -expm1(-exp(-z * (M_PI / sqrt(6))) * (E * exp(-gamma)));
+}
+
+namespace {
+
+// Least-squares line y = a + b * x.
+pair<double, double> fitLine(const vector<pair<double, double>>& xy) {
+  double n = xy.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (auto [x, y] : xy) {
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double den = n * sxx - sx * sx;
+  if (den == 0) { return {0, 0}; }
+  double b = (n * sxy - sx * sy) / den;
+  return {(sy - b * sx) / n, b};
+}
+
+}
+
+float CrossoverTable::fit(u32 fftSize, const vector<pair<float, RoundoffStats>>& samples) {
+  vector<pair<double, double>> logMean, logSD;
+  for (const auto& [bpw, stats] : samples) {
+    if (stats.n && stats.mean > 0 && stats.sd > 0) {
+      logMean.push_back({bpw, log2(stats.mean)});
+      logSD.push_back({bpw, log2(stats.sd)});
+    }
+  }
+  if (logMean.size() < 3) { return 0; }
+
+  auto [aMean, bMean] = fitLine(logMean);
+  auto [aSD, bSD] = fitLine(logSD);
+  if (bMean <= 0 || bSD <= 0) { return 0; }
+
+  auto pErrAt = [&](double bpw) {
+    return RoundoffStats::pErr(bpw * fftSize, exp2(aMean + bMean * bpw), exp2(aSD + bSD * bpw));
+  };
+
+  // pErr grows with the bits-per-word; bisect within the measured range only, never extrapolating beyond it.
+  double lo = samples.front().first, hi = lo;
+  for (const auto& [bpw, stats] : samples) {
+    lo = min(lo, double(bpw));
+    hi = max(hi, double(bpw));
+  }
+  if (pErrAt(lo) > TARGET_PERR) { return 0; }
+  if (pErrAt(hi) > TARGET_PERR) {
+    for (int i = 0; i < 40; ++i) {
+      double mid = (lo + hi) / 2;
+      if (pErrAt(mid) < TARGET_PERR) { lo = mid; } else { hi = mid; }
+    }
+  }
+  return max(lo - MARGIN_BPW, 0.0);
+}
+
+CrossoverTable::CrossoverTable(const fs::path& file) : file{file} {
+  if (file.empty()) { return; }
+  File fi = File::openRead(file);
+  if (!fi) { return; }
+  if (fi.readLine() != string(HEADER) + '\n') {
+    log("%s: ignoring, not '%s'\n", fi.name.c_str(), HEADER);
+    return;
+  }
+  for (const string& line : fi) {
+    char spec[64];
+    float bpw = 0;
+    if (sscanf(line.c_str(), "%63s %f", spec, &bpw) != 2 || bpw < FFTConfig::MIN_BPW || bpw > 20) {
+      log("%s: bad line '%s'\n", fi.name.c_str(), line.c_str());
+      continue;
+    }
+    maxBpw[spec] = bpw;
+    FFTConfig::setMaxBpw(spec, bpw);
+  }
+  if (!maxBpw.empty()) { log("Using the FFT crossovers of %u configs from '%s'\n", u32(maxBpw.size()), fi.name.c_str()); }
+}
+
+void CrossoverTable::save() const {
+  if (file.empty()) { return; }
+  string text = string(HEADER) + '\n';
+  for (const auto& [spec, bpw] : maxBpw) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %.3f\n", bpw);
+    text += spec + buf;
+  }
+  // Via a tmp file, as the table may be shared by the instances of a -pool.
+  if (!File::replace(file, text)) { log("can't write '%s'\n", file.string().c_str()); }
+}
+
+void CrossoverTable::set(const FFTConfig& config, float bpw) {
+  maxBpw[config.spec()] = bpw;
+  FFTConfig::setMaxBpw(config.spec(), bpw);
+  save();
+}
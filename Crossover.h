@@ -0,0 +1,54 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct FFTConfig;
+
+// The per-iteration max roundoff over a run of iterations, as reduced on the GPU with -use STATS.
+struct RoundoffStats {
+  u32 n{};
+  double mean{};
+  double sd{};
+  double max{};
+  double p999{}; // upper bound of the 99.9th percentile
+
+  // The probability of a roundoff above 0.5 in E iterations, fitting a Gumbel distribution to the stats.
+  // See https://en.wikipedia.org/wiki/Gumbel_distribution
+  static double pErr(u32 E, double mean, double sd);
+  double pErr(u32 E) const { return pErr(E, mean, sd); }
+};
+
+// The FFT crossovers measured on this device by -calibrate: for each FFT config, the max bits-per-word that keeps
+// the pErr of a full test under TARGET_PERR. Loading the table makes FFTConfig::maxExp() use it.
+class CrossoverTable {
+  static constexpr const char* HEADER = "gpuowl crossover v1";
+
+  const fs::path file; // empty: not persisted
+  std::map<string, float> maxBpw;
+
+  void save() const;
+
+public:
+  // Same target as the hand-fitted FFTConfig::getMaxExp().
+  static constexpr const double TARGET_PERR = 0.002;
+
+  // Subtracted from the fitted max bits-per-word, as the fit is from a few short runs.
+  static constexpr const double MARGIN_BPW = 0.05;
+
+  // The max bits-per-word at TARGET_PERR, from the roundoff measured at a few bits-per-word near the crossover.
+  // The mean and the SD grow exponentially with the bits-per-word; they are fitted as such. The result is clamped
+  // to the measured range, less MARGIN_BPW. 0 if the fit fails.
+  static float fit(u32 fftSize, const std::vector<std::pair<float, RoundoffStats>>& samples);
+
+  explicit CrossoverTable(const fs::path& file);
+
+  void set(const FFTConfig& config, float bpw);
+};
@@ -7,6 +7,7 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <map>
 #include <string>
 
 using namespace std;
@@ -58,16 +59,10 @@ static double chain_savings[16][8] = {
 	{0.06, 0.0962, 0.1925, 0.0924, 0.0280, 0.0327, 0.0113, 0.0176+0.0058},	// MIDDLE=14
 	{0.05, 0.1045, 0.2090, 0.0897, 0.0413, 0.0358, 0.0094, 0.0176+0.0154}};	// MIDDLE=15
 
-tuple<bool,u32,u32,bool> FFTConfig::getChainLengths(u32 fftSize, u32 exponent, u32 middle) {
-  i32 i;
-  u32 maxExp = getMaxExp(fftSize, middle);
-  double max_bits_per_word = double(maxExp) / double(fftSize);
-  double bits_per_word = double(exponent) / double(fftSize);
-  for (i = 7; i >= 0; i--) {
-    max_bits_per_word -= chain_savings[middle][i];
-    if (bits_per_word >= max_bits_per_word) { break; }
-  }
-  
+namespace {
+
+// i is the last column of chain_savings in use, -1 for none.
+tuple<bool,u32,u32,bool> chainsUpTo(i32 i, u32 middle) {
   auto [mm_chain, mm2_chain] = vector<pair<u32,u32>>{{0, 0}, {0, 0}, {0, 1}, {1, 1}, {1, 2}, {2, 2}, {2, 3}, {3, 3}, {3, 3}}[i + 1];
   if (middle <= 6 && mm2_chain == 3) { mm2_chain = 2; } // For MIDDLE=3-6, mm2_chain=2 is better than mm2_chain=3
   if ((middle == 5 || middle == 7) && mm_chain == 3) { mm_chain = 2; } // For MIDDLE=5,7, mm_chain=2 is better than mm_chain=3
@@ -78,6 +73,40 @@ tuple<bool,u32,u32,bool> FFTConfig::getChainLengths(u32 fftSize, u32 exponent, u
   return {max_accuracy, mm_chain, mm2_chain, ultra_trig};
 }
 
+std::map<string, float> learnedMaxBpw;
+
+}
+
+tuple<bool,u32,u32,bool> FFTConfig::getChainLengths(u32 exponent, const FFTConfig& config) {
+  i32 i;
+  u32 fftSize = config.fftSize();
+  u32 middle = config.middle;
+  double max_bits_per_word = double(config.maxExp()) / double(fftSize);
+  double bits_per_word = double(exponent) / double(fftSize);
+  for (i = 7; i >= 0; i--) {
+    max_bits_per_word -= chain_savings[middle][i];
+    if (bits_per_word >= max_bits_per_word) { break; }
+  }
+  return chainsUpTo(i, middle);
+}
+
+tuple<bool,u32,u32,bool> FFTConfig::getMaxChainLengths(u32 middle) { return chainsUpTo(7, middle); }
+
+void FFTConfig::setMaxBpw(const string& spec, float maxBpw) {
+  FFTConfig config = fromSpec(spec);
+  float cap = float(getMaxExp(config.fftSize(), config.middle)) / config.fftSize() + MAX_LEARNED_GAIN;
+  if (maxBpw > cap) {
+    log("FFT %s: learned max %.3f bits-per-word capped to %.3f\n", spec.c_str(), maxBpw, cap);
+    maxBpw = cap;
+  }
+  learnedMaxBpw[spec] = maxBpw;
+}
+
+u32 FFTConfig::maxExp() const {
+  auto it = learnedMaxBpw.find(spec());
+  return it == learnedMaxBpw.end() ? getMaxExp(fftSize(), middle) : u32(it->second * fftSize());
+}
+
 namespace {
 
 u32 parseInt(const string& s) {
@@ -55,7 +55,16 @@ struct FFTConfig {
   static u32 getMaxCarry32(u32 fftSize, u32 exponent);
   static std::vector<FFTConfig> genConfigs();
 
-  static tuple<bool, u32, u32, bool> getChainLengths(u32 fftSize, u32 exponent, u32 middle);
+  // The chains are chosen by how close the exponent is to the config's maxExp().
+  static tuple<bool, u32, u32, bool> getChainLengths(u32 exponent, const FFTConfig& config);
+
+  // All the accuracy options, as used at maxExp().
+  static tuple<bool, u32, u32, bool> getMaxChainLengths(u32 middle);
+
+  // The max bits-per-word measured for a config by -calibrate (see Crossover.h); overrides getMaxExp(),
+  // but may exceed it by at most MAX_LEARNED_GAIN bits-per-word.
+  static constexpr const float MAX_LEARNED_GAIN = 0.1;
+  static void setMaxBpw(const string& spec, float maxBpw);
 
   // FFTConfig(u32 w, u32 m, u32 h) : width(w), middle(m), height(h) {}
   static FFTConfig fromSpec(const string& spec);
@@ -65,6 +74,6 @@ struct FFTConfig {
   u32 height = 0;
     
   u32 fftSize() const { return width * height * middle * 2; }
-  u32 maxExp() const { return getMaxExp(fftSize(), middle); }
+  u32 maxExp() const;
   std::string spec() const { return numberK(width) + ':' + numberK(middle) + ':' + numberK(height); }
 };
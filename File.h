@@ -64,6 +64,23 @@ public:
   
   static void append(const fs::path& name, std::string_view text) { File::openAppend(name).write(text); }
 
+  // Replaces the content of the file by writing a tmp file then renaming it, so that a reader (possibly another
+  // instance sharing the dir) never sees a partial file. Returns false if it could not be written.
+  static bool replace(const fs::path& name, std::string_view text) {
+    fs::path tmp = name;
+    tmp += "."s + std::to_string(getpid()) + ".tmp";
+    try {
+      File::openWrite(tmp).write(text);
+      fs::rename(tmp, name);
+      return true;
+    } catch (const fs::filesystem_error&) {
+    } catch (const std::ios_base::failure&) {
+    }
+    std::error_code noThrow;
+    fs::remove(tmp, noThrow);
+    return false;
+  }
+
   File(FILE* f, const string& name) : f{f}, readOnly{false}, name{name} {}
   
   File(File&& other) : f{other.f}, readOnly{other.readOnly}, name{other.name} { other.f = nullptr; }
@@ -14,6 +14,9 @@
 #include "Task.h"
 #include "Memlock.h"
 #include "B1Accumulator.h"
+#include "KernelCache.h"
+#include "Worktodo.h"
+#include "parallel.h"
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -44,17 +47,56 @@ using float3 = tuple<float, float, float>;
 
 struct Weights {
   vector<double> threadWeightsIF;
-  vector<float3> threadWeightsIFSP;
-  
   vector<double> carryWeightsIF;
-  vector<float3> carryWeightsIFSP;
   
   vector<u32> bitsCF;
   vector<u32> bitsC;
+
+  double weightStep;
+  double iWeightStep;
+  vector<double> fWeights;
+  vector<double> iWeights;
+  vector<double> fWeightSteps;
+  vector<double> iWeightSteps;
+
+  // Applies "f" to each member in turn; used for (de)serialization.
+  template<typename F> void visit(F&& f) {
+    f(threadWeightsIF); f(carryWeightsIF); f(bitsCF); f(bitsC); f(weightStep); f(iWeightStep);
+    f(fWeights); f(iWeights); f(fWeightSteps); f(iWeightSteps);
+  }
+};
+
+struct Trig {
+  vector<double2> smallW;
+  vector<double2> smallH;
+  vector<double2> middle;
+
+  // The tables passed to writeGlobals.
+  vector<double2> dp1, dp2, dp3, dp4;
+
+  template<typename F> void visit(F&& f) { f(smallW); f(smallH); f(middle); f(dp1); f(dp2); f(dp3); f(dp4); }
+};
+
+// Produced by GpuSession::prepareNext(), consumed by Gpu::make() and by the task.
+struct Prepared {
+  u32 E;
+  u32 B1;
+  u32 B2;
+  string key;
+  future<Holder<cl_program>> program; // not valid if the program was already in the session
+  future<Weights> weights;
+  future<Trig> trig;                  // not valid if the FFT is the same as the current one's
+  future<vector<bool>> powerSmooth;
+  future<vector<bool>> primes;
 };
 
 namespace {
 
+// The layout of bufRoundoff, see updateStats() in gpuowl.cl.
+constexpr const u32 ROUNDOFF_BINS = 128;
+constexpr const u32 ROUNDOFF_BIN0 = 119 << 4;
+constexpr const u32 ROUNDOFF_WORDS = 8 + ROUNDOFF_BINS;
+
 // Returns the primitive root of unity of order N, to the power k.
 
 template<typename T>
@@ -78,7 +120,7 @@ pair<T, T> root1(u32 N, u32 k) {
   }
 }
 
-double2 *smallTrigBlock(u32 W, u32 H, double2 *p) {
+[[maybe_unused]] double2 *smallTrigBlock(u32 W, u32 H, double2 *p) {
   for (u32 line = 1; line < H; ++line) {
     for (u32 col = 0; col < W; ++col) {
       *p++ = root1<double>(W * H, line * col);
@@ -87,7 +129,7 @@ double2 *smallTrigBlock(u32 W, u32 H, double2 *p) {
   return p;
 }
 
-ConstBuffer<double2> genSmallTrig(const Context& context, u32 size, u32 radix) {
+vector<double2> genSmallTrig(u32 size, u32 radix) {
   vector<double2> tab;
 
   // smallTrigBlock(size / radix, 2, tab.data());
@@ -104,28 +146,33 @@ ConstBuffer<double2> genSmallTrig(const Context& context, u32 size, u32 radix) {
   for (u32 w = radix; w < size; w *= radix) { p = smallTrigBlock(w, std::min(radix, size / w), p); }
   assert(p - tab.data() == size);
   */
-  return {context, "smallTrig", tab};
+  return tab;
 }
 
-ConstBuffer<double2> genMiddleTrig(const Context& context, u32 smallH, u32 middle) {
+vector<double2> genMiddleTrig(u32 smallH, u32 middle) {
   vector<double2> tab;
   if (middle == 1) {
     tab.resize(1);
   } else {  
     u32 size = smallH * (middle - 1);
     tab.resize(size);
-    auto *p = smallTrigBlock(smallH, middle, tab.data());
-    assert(p - tab.data() == size);
+    // The same as smallTrigBlock(smallH, middle, tab.data()), split by lines.
+    parallelFor(middle - 1, [&tab, smallH, middle](u32 begin, u32 end) {
+      for (u32 line = begin + 1; line < end + 1; ++line) {
+        for (u32 col = 0; col < smallH; ++col) { tab[(line - 1) * smallH + col] = root1<double>(smallH * middle, line * col); }
+      }
+    }, 1);
   }
-  return {context, "middleTrig", tab};
+  return tab;
 }
 
 template<typename T>
 vector<pair<T, T>> makeTrig(u32 n) {
   assert(n % 8 == 0);
-  vector<pair<T, T>> tab;
-  tab.reserve(n/8 + 1);
-  for (u32 k = 0; k <= n/8; ++k) { tab.push_back(root1<T>(n, k)); }
+  vector<pair<T, T>> tab(n/8 + 1);
+  parallelFor(n/8 + 1, [&tab, n](u32 begin, u32 end) {
+    for (u32 k = begin; k < end; ++k) { tab[k] = root1<T>(n, k); }
+  });
   return tab;
 }
 
@@ -139,6 +186,12 @@ vector<pair<T, T>> makeTinyTrig(u32 W, u32 hN) {
   return tab;
 }
 
+Trig genTrig(u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH) {
+  u32 hN = W * BIG_H;
+  return {genSmallTrig(W, nW), genSmallTrig(SMALL_H, nH), genMiddleTrig(SMALL_H, BIG_H / SMALL_H),
+          makeTrig<double>(2 * SMALL_H), makeTrig<double>(BIG_H), makeTrig<double>(hN), makeTinyTrig<double>(W, hN)};
+}
+
 u32 kAt(u32 H, u32 line, u32 col) { return (line + col * H) * 2; }
 
 auto weight(u32 N, u32 E, u32 H, u32 line, u32 col, u32 rep) {
@@ -155,7 +208,8 @@ double boundUnderOne(double x) { return std::min(x, nexttoward(1, 0)); }
 
 #define CARRY_LEN 8
 
-float3 to3SP(f128 x);
+// Words per group of the packLast/packDigits kernels, as in gpuowl.cl.
+#define PACK_BLOCK 2048
 
 Weights genWeights(u32 E, u32 W, u32 H, u32 nW) {
   u32 N = 2u * W * H;
@@ -164,66 +218,163 @@ Weights genWeights(u32 E, u32 W, u32 H, u32 nW) {
 
   // Inverse + Forward
   vector<double> threadWeightsIF;
-  vector<float3> threadWeightsIFSP;
   for (u32 thread = 0; thread < groupWidth; ++thread) {
     auto iw = invWeight(N, E, H, 0, thread, 0);
     threadWeightsIF.push_back(iw - 1);
-    threadWeightsIFSP.push_back(to3SP(iw));
     auto w = weight(N, E, H, 0, thread, 0);
     threadWeightsIF.push_back(w - 1);
-    threadWeightsIFSP.push_back(to3SP(w));
   }
 
   // Inverse only. Also the group order matches CarryA/M (not fftP/CarryFused).
-  vector<double> carryWeightsIF;
-  vector<float3> carryWeightsIFSP;
-  for (u32 gy = 0; gy < H / CARRY_LEN; ++gy) {
-    auto iw = invWeight(N, E, H, gy * CARRY_LEN, 0, 0);
-    carryWeightsIF.push_back(2 * boundUnderOne(iw));
-    carryWeightsIFSP.push_back(to3SP(2 * iw));
-    
-    auto w = weight(N, E, H, gy * CARRY_LEN, 0, 0);
-    carryWeightsIF.push_back(2 * w);
-    carryWeightsIFSP.push_back(to3SP(2 * w));
-  }
-  
-  vector<u32> bits;
-  
-  for (u32 line = 0; line < H; ++line) {
-    for (u32 thread = 0; thread < groupWidth; ) {
-      std::bitset<32> b;
-      for (u32 bitoffset = 0; bitoffset < 32; bitoffset += nW*2, ++thread) {
-        for (u32 block = 0; block < nW; ++block) {
-          for (u32 rep = 0; rep < 2; ++rep) {
-            if (isBigWord(N, E, kAt(H, line, block * groupWidth + thread) + rep)) { b.set(bitoffset + block * 2 + rep); }
-          }        
-	}
-      }
-      bits.push_back(b.to_ulong());
+  vector<double> carryWeightsIF(H / CARRY_LEN * 2);
+  parallelFor(H / CARRY_LEN, [&](u32 begin, u32 end) {
+    for (u32 gy = begin; gy < end; ++gy) {
+      auto iw = invWeight(N, E, H, gy * CARRY_LEN, 0, 0);
+      carryWeightsIF[2 * gy] = 2 * boundUnderOne(iw);
+      auto w = weight(N, E, H, gy * CARRY_LEN, 0, 0);
+      carryWeightsIF[2 * gy + 1] = 2 * w;
     }
-  }
-  assert(bits.size() == N / 32);
-  
-  vector<u32> bitsC;
-  
-  for (u32 gy = 0; gy < H / CARRY_LEN; ++gy) {
-    for (u32 gx = 0; gx < nW; ++gx) {
+  }, 256);
+
+  // Each line (resp. gy) produces groupWidth / (32 / (2 * nW)) (resp. nW * groupWidth / 16) words.
+  vector<u32> bits(N / 32);
+  parallelFor(H, [&](u32 begin, u32 end) {
+    auto out = bits.begin() + begin * (groupWidth * nW * 2 / 32);
+    for (u32 line = begin; line < end; ++line) {
       for (u32 thread = 0; thread < groupWidth; ) {
         std::bitset<32> b;
-        for (u32 bitoffset = 0; bitoffset < 32; bitoffset += CARRY_LEN * 2, ++thread) {
-          for (u32 block = 0; block < CARRY_LEN; ++block) {
+        for (u32 bitoffset = 0; bitoffset < 32; bitoffset += nW*2, ++thread) {
+          for (u32 block = 0; block < nW; ++block) {
             for (u32 rep = 0; rep < 2; ++rep) {
-              if (isBigWord(N, E, kAt(H, gy * CARRY_LEN + block, gx * groupWidth + thread) + rep)) { b.set(bitoffset + block * 2 + rep); }
+              if (isBigWord(N, E, kAt(H, line, block * groupWidth + thread) + rep)) { b.set(bitoffset + block * 2 + rep); }
+            }
+          }
+        }
+        *out++ = b.to_ulong();
+      }
+    }
+  }, 64);
+  
+  vector<u32> bitsC(N / 32);
+  parallelFor(H / CARRY_LEN, [&](u32 begin, u32 end) {
+    auto out = bitsC.begin() + begin * (nW * groupWidth * CARRY_LEN * 2 / 32);
+    for (u32 gy = begin; gy < end; ++gy) {
+      for (u32 gx = 0; gx < nW; ++gx) {
+        for (u32 thread = 0; thread < groupWidth; ) {
+          std::bitset<32> b;
+          for (u32 bitoffset = 0; bitoffset < 32; bitoffset += CARRY_LEN * 2, ++thread) {
+            for (u32 block = 0; block < CARRY_LEN; ++block) {
+              for (u32 rep = 0; rep < 2; ++rep) {
+                if (isBigWord(N, E, kAt(H, gy * CARRY_LEN + block, gx * groupWidth + thread) + rep)) { b.set(bitoffset + block * 2 + rep); }
+              }
             }
           }
+          *out++ = b.to_ulong();
         }
-        bitsC.push_back(b.to_ulong());
       }
     }
+  }, 8);
+
+  vector<double> iWeights;
+  vector<double> fWeights;
+  for (u32 i = 0; i < CARRY_LEN; ++i) {
+    iWeights.push_back(invWeight(N, E, H, 0, 0, 2*i) - 1);
+    fWeights.push_back(weight(N, E, H, 0, 0, 2*i) - 1);
   }
-  assert(bitsC.size() == N / 32);
 
-  return Weights{threadWeightsIF, threadWeightsIFSP, carryWeightsIF, carryWeightsIFSP, bits, bitsC};
+  // 2^(k/8) - 1 for the k corresponding to the word i * (N / nW).
+  u32 step = N - E % N;
+  vector<double> iWeightSteps;
+  vector<double> fWeightSteps;
+  for (u32 i = 0; i < nW; ++i) {
+    f128 k = i * step % nW * (8 / nW);
+    iWeightSteps.push_back(exp2q(-k / 8) - 1);
+    fWeightSteps.push_back(exp2q(k / 8) - 1);
+  }
+
+  return Weights{threadWeightsIF, carryWeightsIF, bits, bitsC,
+                 double(weight(N, E, H, 0, 0, 1) - 1), double(invWeight(N, E, H, 0, 0, 1) - 1),
+                 fWeights, iWeights, fWeightSteps, iWeightSteps};
+}
+
+// (De)serialization of the Trig and Weights tables, for the disk cache.
+struct TableWriter {
+  string bytes;
+
+  void append(const void* data, size_t size) { bytes.append(reinterpret_cast<const char*>(data), size); }
+
+  template<typename T> void operator()(const vector<T>& v) {
+    u32 n = v.size();
+    append(&n, sizeof(n));
+    append(v.data(), n * sizeof(T));
+  }
+
+  void operator()(double x) { append(&x, sizeof(x)); }
+};
+
+struct TableReader {
+  string_view bytes;
+  bool ok = true;
+
+  void take(void* data, size_t size) {
+    if (!ok || bytes.size() < size) {
+      ok = false;
+      return;
+    }
+    memcpy(data, bytes.data(), size);
+    bytes.remove_prefix(size);
+  }
+
+  template<typename T> void operator()(vector<T>& v) {
+    u32 n = 0;
+    take(&n, sizeof(n));
+    if (ok && bytes.size() >= u64(n) * sizeof(T)) {
+      v.resize(n);
+      take(v.data(), n * sizeof(T));
+    } else {
+      ok = false;
+    }
+  }
+
+  void operator()(double& x) { take(&x, sizeof(x)); }
+};
+
+// Bump when the layout or the content of the tables changes.
+constexpr const u32 TABLES_VERSION = 1;
+
+template<typename T, typename Gen>
+T loadOrGen(const Args& args, const string& name, Gen gen) {
+  if (!args.useCache) { return gen(); }
+
+  KernelCache cache{args.cacheDir};
+  if (string bytes = cache.load(name); !bytes.empty()) {
+    T tables;
+    TableReader reader{bytes};
+    tables.visit(reader);
+    if (reader.ok && reader.bytes.empty()) { return tables; }
+    log("table cache: '%s' is malformed\n", name.c_str());
+  }
+
+  T tables = gen();
+  TableWriter writer;
+  tables.visit(writer);
+  cache.store(name, writer.bytes);
+  return tables;
+}
+
+// The trig tables depend only on the FFT, thus they are shared by all the exponents.
+Trig cachedTrig(const Args& args, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH) {
+  string name = "trig"s + to_string(TABLES_VERSION) + '-' + to_string(W) + '-' + to_string(BIG_H) + '-' + to_string(SMALL_H) + ".bin";
+  return loadOrGen<Trig>(args, name, [=]() { return genTrig(W, BIG_H, SMALL_H, nW, nH); });
+}
+
+// The weights depend on the exponent too; only the few most recent ones are kept.
+Weights cachedWeights(const Args& args, u32 E, u32 W, u32 H, u32 nW) {
+  string prefix = "weights"s + to_string(TABLES_VERSION) + '-';
+  string name = prefix + to_string(E) + '-' + to_string(W) + '-' + to_string(H) + ".bin";
+  Weights weights = loadOrGen<Weights>(args, name, [=]() { return genWeights(E, W, H, nW); });
+  if (args.useCache) { KernelCache{args.cacheDir}.trim(prefix, 8); }
+  return weights;
 }
 
 string toLiteral(u32 value) { return to_string(value) + 'u'; }
@@ -274,7 +425,7 @@ struct Define {
   operator string() const { return str; }
 };
 
-float3 to3SP(f128 x) {
+[[maybe_unused]] float3 to3SP(f128 x) {
   // auto ref = x;
   float a = x;
   x -= a;
@@ -287,12 +438,23 @@ float3 to3SP(f128 x) {
   return ret;
 }
 
-cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N, u32 E, u32 WIDTH, u32 SMALL_HEIGHT, u32 MIDDLE, u32 nW) {
+string getClArgs(const Args& args, u32 N) {
   string clArgs = args.dump.empty() ? ""s : (" -save-temps="s + args.dump + "/" + numberK(N));
   if (!args.safeMath) { clArgs += " -cl-unsafe-math-optimizations"; }
-  
+  return clArgs;
+}
+
+string flagLabel(const string& flag) {
+  auto pos = flag.find('=');
+  return (pos == string::npos) ? flag : flag.substr(0, pos);
+}
+
+// The tunedFlags apply only where the -use flags don't say otherwise.
+vector<string> getDefines(const Args& args, cl_device_id id, u32 N, u32 E, u32 WIDTH, u32 SMALL_HEIGHT, u32 MIDDLE,
+                          const vector<string>& tunedFlags) {
+  // The exponent itself is not compiled in, only its bits-per-word; thus the program can be reused across exponents.
   vector<Define> defines =
-    {{"EXP", E},
+    {{"WORD_BITS", E / N},
      {"WIDTH", WIDTH},
      {"SMALL_HEIGHT", SMALL_HEIGHT},
      {"MIDDLE", MIDDLE},
@@ -304,34 +466,31 @@ cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N,
   if (FFTConfig::getMaxCarry32(N, E) > 0x6C00) { defines.push_back({"CARRY64", 1}); }
 
   // If we are near the maximum exponent for this FFT, then we may need to set some chain #defines
-  // to reduce the round off errors.
-  auto [max_accuracy, mm_chain, mm2_chain, ultra_trig] = FFTConfig::getChainLengths(N, E, MIDDLE);
+  // to reduce the round off errors. The calibration measures the FFT as used at its maximum exponent.
+  bool calibrating = !args.calibrate.empty();
+  auto [max_accuracy, mm_chain, mm2_chain, ultra_trig] = calibrating
+    ? FFTConfig::getMaxChainLengths(MIDDLE)
+    : FFTConfig::getChainLengths(E, FFTConfig{WIDTH, MIDDLE, SMALL_HEIGHT});
   if (mm_chain) { defines.push_back({"MM_CHAIN", mm_chain}); }
   if (mm2_chain) { defines.push_back({"MM2_CHAIN", mm2_chain}); }
   if (max_accuracy) { defines.push_back({"MAX_ACCURACY", 1}); }
   if (ultra_trig) { defines.push_back({"ULTRA_TRIG", 1}); }
+  if ((calibrating || args.tuneExp) && !args.flags.count("STATS")) { defines.push_back({"STATS", 1}); }
 
-  defines.push_back({"WEIGHT_STEP", double(weight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 1) - 1)});
-  defines.push_back({"IWEIGHT_STEP", double(invWeight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 1) - 1)});
 
-  vector<double> iWeights;
-  vector<double> fWeights;
-  for (u32 i = 0; i < CARRY_LEN; ++i) {
-    iWeights.push_back(invWeight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 2*i) - 1);
-    fWeights.push_back(weight(N, E, SMALL_HEIGHT * MIDDLE, 0, 0, 2*i) - 1);
-  }
-  defines.push_back({"IWEIGHTS", iWeights});
-  defines.push_back({"FWEIGHTS", fWeights});
-  
   string clSource = CL_SOURCE;
-  for (const string& flag : args.flags) {
-    auto pos = flag.find('=');
-    string label = (pos == string::npos) ? flag : flag.substr(0, pos);
+  std::set<string> labels;
+  for (const string& flag : args.flags) { labels.insert(flagLabel(flag)); }
+  vector<string> flags{args.flags.begin(), args.flags.end()};
+  for (const string& flag : tunedFlags) { if (!labels.count(flagLabel(flag))) { flags.push_back(flag); } }
+
+  for (const string& flag : flags) {
+    string label = flagLabel(flag);
     if (clSource.find(label) == string::npos) {
       log("%s not used\n", label.c_str());
       throw "-use with unknown key";
     }
-    if (pos == string::npos) {
+    if (label == flag) {
       defines.push_back({label, 1});
     } else {
       defines.push_back(Define{flag});
@@ -340,12 +499,17 @@ cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N,
 
   vector<string> strDefines;
   strDefines.insert(strDefines.begin(), defines.begin(), defines.end());
+  return strDefines;
+}
 
+cl_program compile(const Args& args, cl_context context, cl_device_id id, const string& clArgs, const vector<string>& strDefines) {
   cl_program program{};
-  if (args.binaryFile.empty()) {
-    program = compile(context, id, CL_SOURCE, clArgs, strDefines);
-  } else {
+  if (!args.binaryFile.empty()) {
     program = loadBinary(context, id, args.binaryFile);
+  } else if (args.useCache && args.dump.empty()) {
+    program = KernelCache{args.cacheDir}.compile(context, id, CL_SOURCE, clArgs, strDefines);
+  } else {
+    program = compile(context, id, CL_SOURCE, clArgs, strDefines);
   }
   if (!program) { throw "OpenCL compilation"; }
   // dumpBinary(program, "dump.bin");
@@ -354,15 +518,33 @@ cl_program compile(const Args& args, cl_context context, cl_device_id id, u32 N,
 
 }
 
-Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-         cl_device_id device, bool timeKernels, bool useLongCarry)
-  : Gpu{args, E, W, BIG_H, SMALL_H, nW, nH, device, timeKernels, useLongCarry, genWeights(E, W, BIG_H, nW)}
+namespace {
+
+// Names the device in file names: its unique id when known.
+string deviceName(const string& uid, cl_device_id device, int seqId) {
+  string name = uid.empty() ? getShortInfo(device) + "-" + to_string(seqId) : uid;
+  for (char& c : name) { if (!isalnum(c) && c != '-') { c = '_'; } }
+  return name;
+}
+
+}
+
+GpuSession::GpuSession(const Args& args) :
+  args{args},
+  device{getDevice(args.device)},
+  context{device},
+  queue{Queue::make(context, args.timeKernels || !args.bench.empty(), args.timeSample, args.cudaYield, args.trace)},
+  checkPolicy{args.useCache ? args.cacheDir / ("errors-" + deviceName(args.uid, device, args.device) + ".txt") : fs::path{}},
+  crossovers{args.useCache ? args.cacheDir / ("crossover-" + deviceName(args.uid, device, args.device) + ".txt") : fs::path{}},
+  tuning{args.useCache ? args.cacheDir / ("tune-" + deviceName(args.uid, device, args.device) + ".txt") : fs::path{}}
 {}
 
+GpuSession::~GpuSession() = default;
+
 using float2 = pair<float, float>;
 
-Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-         cl_device_id device, bool timeKernels, bool useLongCarry, Weights&& weights) :
+Gpu::Gpu(GpuSession& session, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
+         cl_program program, bool useLongCarry, Weights&& weights, Trig&& trig) :
   E(E),
   N(W * BIG_H * 2),
   hN(N / 2),
@@ -371,16 +553,18 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   bufSize(N * sizeof(double)),
   WIDTH(W),
   useLongCarry(useLongCarry),
-  timeKernels(timeKernels),
-  device(device),
-  context{device},
-  program(compile(args, context.get(), device, N, E, W, SMALL_H, BIG_H / SMALL_H, nW)),
-  queue(Queue::make(context, timeKernels, args.cudaYield)),
+  timeKernels(session.args.timeKernels),
+  hostPack(session.args.flags.count("HOST_PACK")),
+  session{session},
+  device(session.device),
+  context{session.context},
+  program(program),
+  queue(session.queue),
 
   // Specifies size in number of workgroups
-#define LOAD(name, nGroups) name{program.get(), queue, device, nGroups, #name}
+#define LOAD(name, nGroups) name{program, queue, device, nGroups, #name}
   // Specifies size in "work size": workSize == nGroups * groupSize
-#define LOAD_WS(name, workSize) name{program.get(), queue, device, #name, workSize}
+#define LOAD_WS(name, workSize) name{program, queue, device, #name, workSize}
   
   LOAD(carryFused,    BIG_H + 1),
   LOAD(carryFusedMul, BIG_H + 1),
@@ -409,30 +593,40 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   LOAD(isNotZero, 256),
   LOAD(isEqual, 256),
   LOAD(sum64, 256),
+  LOAD(packLast, N / PACK_BLOCK),
+  LOAD(packScan, 1),
+  LOAD(packDigits, N / PACK_BLOCK),
+  LOAD_WS(packBits, N / 8 * 5 + 256),
+  LOAD_WS(unpackBits, N),
 #undef LOAD_WS
 #undef LOAD
 
-  bufTrigW{genSmallTrig(context, W, nW)},
-  bufTrigH{genSmallTrig(context, SMALL_H, nH)},
-  bufTrigM{genMiddleTrig(context, SMALL_H, BIG_H / SMALL_H)},
-  bufBits{context, "bits", weights.bitsCF},
-  bufBitsC{context, "bitsC", weights.bitsC},
+  bufTrigW{context, "smallTrig", trig.smallW},
+  bufTrigH{context, "smallTrig", trig.smallH},
+  bufTrigM{context, "middleTrig", trig.middle},
+  bufBits{queue, "bits", N / 32},
+  bufBitsC{queue, "bitsC", N / 32},
   bufData{queue, "data", N},
   bufAux{queue, "aux", N},
   bufCheck{queue, "check", N},
+  bufSnapData{queue, "snapData", N},
+  bufSnapCheck{queue, "snapCheck", N},
   bufCarry{queue, "carry", N / 2},
   bufReady{queue, "ready", BIG_H},
-  bufRoundoff{queue, "roundoff", 8 + 1024 * 1024},
+  bufRoundoff{queue, "roundoff", ROUNDOFF_WORDS},
   bufCarryMax{queue, "carryMax", 8},
   bufCarryMulMax{queue, "carryMulMax", 8},
   bufSmallOut{queue, "smallOut", 256},
   bufSumOut{queue, "sumOut", 1},
+  bufPackCodes{queue, "packCodes", N / PACK_BLOCK},
+  bufPackBorrow{queue, "packBorrow", N / PACK_BLOCK},
+  bufPacked{queue, "packed", N / 8 * 5 + 256},
   buf1{queue, "buf1", N},
   buf2{queue, "buf2", N},
   buf3{queue, "buf3", N},
-  args{args}
+  args{session.args}
 {
-  // dumpBinary(program.get(), "isa.bin");
+  // dumpBinary(program, "isa.bin");
   /*
   log("SQRT1_2 %s\n", toLiteral(to3SP(M_SQRT1_2q)).c_str());
 
@@ -474,10 +668,13 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
   tailFusedSquare.setFixedArgs(2, bufTrigH, bufTrigH);
   tailSquareLow.setFixedArgs(2, bufTrigH, bufTrigH);
 
-  bufReady.zero();
-  bufRoundoff.zero();
-  bufCarryMax.zero();
-  bufCarryMulMax.zero();
+  setKernelCosts(W, SMALL_H, BIG_H / SMALL_H);
+
+  // The squaring iteration without lead-in/lead-out, from buf1 to buf1; see coreStep().
+  steadySquaring.add(tailFusedSquare, buf2, buf1);
+  steadySquaring.add(fftMiddleOut, buf1, buf2);
+  steadySquaring.add(carryFused, buf2, buf1);
+  steadySquaring.add(fftMiddleIn, buf1, buf2);
 
   vector<float2> readTrigSH, readTrigBH, readTrigN;
   {
@@ -486,24 +683,114 @@ Gpu::Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
       bufBH{queue, "readTrigBH", BIG_H/8 + 1},
       bufN{queue, "readTrigN", hN/8+1};
         
-    Kernel{program.get(), queue, device, 32, "readHwTrig"}(bufSH, bufBH, bufN);
+    Kernel{program, queue, device, 32, "readHwTrig"}(bufSH, bufBH, bufN);
     readTrigSH = bufSH.read();
     readTrigBH = bufBH.read();
     readTrigN = bufN.read();
 
-    Kernel{program.get(), queue, device, 32, "writeGlobals"}(ConstBuffer{context, "dp1", makeTrig<double>(2 * SMALL_H)},
-                                                             ConstBuffer{context, "dp2", makeTrig<double>(BIG_H)},
-                                                             ConstBuffer{context, "dp3", makeTrig<double>(hN)},
-                                                             ConstBuffer{context, "dp4", makeTinyTrig<double>(W, hN)},
+    Kernel{program, queue, device, 32, "writeGlobals"}(ConstBuffer{context, "dp1", trig.dp1},
+                                                       ConstBuffer{context, "dp2", trig.dp2},
+                                                       ConstBuffer{context, "dp3", trig.dp3},
+                                                       ConstBuffer{context, "dp4", trig.dp4});
+  }
+
+  writeWeights(weights);
+}
+
+Gpu::~Gpu() = default;
+
+// Only the traffic of the N-sized buffers is counted (the trig tables are small and mostly cached), and the FLOPs
+// of a complex FFT of length n are taken as 5 * n * log2(n), plus about 6 per complex value for the twiddles or weights.
+void Gpu::setKernelCosts(u32 W, u32 SMALL_H, u32 MIDDLE) {
+  double D = N * sizeof(double); // the FFT data
+  double I = N * sizeof(int);    // the words
+  double B = N / 8;              // the bits
+  double flopsW = 5.0 * hN * log2(W) + 6.0 * hN;
+  double flopsH = 5.0 * hN * log2(SMALL_H) + 6.0 * hN;
+  double flopsM = 5.0 * hN * log2(MIDDLE) + 6.0 * hN;
+
+  auto set = [this](Kernel& kernel, double bytesRead, double bytesWritten, double flops) {
+    kernel.setCost({bytesRead, bytesWritten, flops});
+    costedKernels.push_back(&kernel);
+  };
+
+  set(fftP, I, D, flopsW);
+  set(fftW, D, D, flopsW);
+  set(fftHin, D, D, flopsH);
+  set(fftHout, D, D, flopsH);
+  set(fftMiddleIn, D, D, flopsM);
+  set(fftMiddleOut, D, D, flopsM);
+  // Inverse FFT, carry, forward FFT.
+  set(carryFused, D + B, D, 2 * flopsW + 10.0 * N);
+  set(carryFusedMul, D + B, D, 2 * flopsW + 12.0 * N);
+  set(carryA, D + B, I, 10.0 * N);
+  set(carryM, D + B, I, 12.0 * N);
+  set(carryB, I + B, I, 2.0 * N);
+  set(transposeW, D, D, 0);
+  set(transposeH, D, D, 0);
+  set(transposeIn, I, I, 0);
+  set(transposeOut, I, I, 0);
+  set(kernelMultiply, 2 * D, D, 6.0 * hN);
+  set(kernelMultiplyDelta, 3 * D, D, 8.0 * hN);
+  // Inverse FFT, pointwise, forward FFT.
+  set(tailFusedSquare, D, D, 2 * flopsH + 6.0 * hN);
+  set(tailSquareLow, D, D, flopsH + 6.0 * hN);
+  set(tailFusedMul, 2 * D, D, 3 * flopsH + 6.0 * hN);
+  set(tailFusedMulLow, 2 * D, D, 2 * flopsH + 6.0 * hN);
+  set(tailMulLowLow, 2 * D, D, flopsH + 6.0 * hN);
+  set(tailFusedMulDelta, 3 * D, D, 3 * flopsH + 8.0 * hN);
+}
+
+const KernelCost* Gpu::findCost(const string& name) {
+  for (Kernel* kernel : costedKernels) {
+    if (kernel->getName() == name) { return &kernel->getCost(); }
+  }
+  return nullptr;
+}
+
+// The achieved device-to-device copy rate, counting both the read and the write, as the practical bandwidth ceiling.
+double Gpu::measureCopyGBps() {
+  const u32 nCopies = 20;
+  finish();
+  Timer timer;
+  for (u32 i = 0; i < nCopies; ++i) { buf2 << buf1; }
+  finish();
+  return 2.0 * nCopies * N * sizeof(double) / timer.elapsedSecs() * 1e-9;
+}
 
-                                                             ConstBuffer{context, "w2", weights.threadWeightsIF},
-                                                             ConstBuffer{context, "w3", weights.carryWeightsIF}
-                                                             );
-  }
+void Gpu::writeWeights(const Weights& weights) {
+  bufBits << ConstBuffer{context, "bits", weights.bitsCF};
+  bufBitsC << ConstBuffer{context, "bitsC", weights.bitsC};
 
+  Kernel{program, queue, device, 32, "writeWeights"}(ConstBuffer{context, "w2", weights.threadWeightsIF},
+                                                     ConstBuffer{context, "w3", weights.carryWeightsIF},
+                                                     weights.weightStep, weights.iWeightStep,
+                                                     ConstBuffer{context, "fWeights", weights.fWeights},
+                                                     ConstBuffer{context, "iWeights", weights.iWeights},
+                                                     ConstBuffer{context, "fWeightSteps", weights.fWeightSteps},
+                                                     ConstBuffer{context, "iWeightSteps", weights.iWeightSteps});
+  bufReady.zero();
+  bufRoundoff.zero();
+  bufCarryMax.zero();
+  bufCarryMulMax.zero();
   finish();
-  
-  program.reset();
+}
+
+void Gpu::setExponent(u32 newE, bool newUseLongCarry, Weights&& weights) {
+  E = newE;
+  useLongCarry = newUseLongCarry;
+  writeWeights(weights);
+  queue->clearProfile();
+}
+
+vector<bool> Gpu::takePowerSmooth(u32 b1) {
+  if (prepared && prepared->powerSmooth.valid() && prepared->B1 == b1) { return prepared->powerSmooth.get(); }
+  return {};
+}
+
+vector<bool> Gpu::takePrimes(u32 b1, u32 b2) {
+  if (prepared && prepared->primes.valid() && prepared->B1 == b1 && prepared->B2 == b2) { return prepared->primes.get(); }
+  return Pm1Plan::sieve(b1, b2);
 }
 
 vector<Buffer<i32>> Gpu::makeBufVector(u32 size) {
@@ -582,17 +869,86 @@ Words Gpu::fold(vector<Buffer<int>>& bufs) {
   return {};
 }
 
-unique_ptr<Gpu> Gpu::make(u32 E, const Args &args) {
-  FFTConfig config = getFFTConfig(E, args.fftSpec);
-  u32 WIDTH        = config.width;
-  u32 SMALL_HEIGHT = config.height;
-  u32 MIDDLE       = config.middle;
-  u32 N = WIDTH * SMALL_HEIGHT * MIDDLE * 2;
+namespace {
+
+// Everything about the FFT and the program that is determined by the exponent.
+struct Layout {
+  FFTConfig config;
+  u32 N, nW, nH;
+  float bitsPerWord;
+  string clArgs;
+  vector<string> defines;
+  string key;
+
+  // Without a variant, the FFT is chosen from -fft or by the exponent.
+  Layout(const Args& args, cl_device_id device, u32 E, const Variant* variant) :
+    config{getFFTConfig(E, variant ? variant->spec : args.fftSpec)},
+    N{config.width * config.height * config.middle * 2},
+    nW{(config.width == 1024 || config.width == 256) ? 4u : 8u},
+    nH{(config.height == 1024 || config.height == 256) ? 4u : 8u},
+    bitsPerWord{E / float(N)},
+    clArgs{getClArgs(args, N)},
+    defines{getDefines(args, device, N, E, config.width, config.height, config.middle, variant ? variant->flags : vector<string>{})},
+    key{buildArgs(clArgs, defines)} {
+  }
+
+  bool bpwOK() const { return bitsPerWord <= 20 && bitsPerWord >= FFTConfig::MIN_BPW; }
+  u32 bigH() const { return config.height * config.middle; }
+};
+
+}
+
+void GpuSession::prepareNext(const Task& current) {
+  if (prepared) { return; }
 
-  u32 nW = (WIDTH == 1024 || WIDTH == 256) ? 4 : 8;
-  u32 nH = (SMALL_HEIGHT == 1024 || SMALL_HEIGHT == 256) ? 4 : 8;
+  optional<Task> task = Worktodo::peekNext(args, current);
+  if (!task || task->kind != Task::PRP) { return; }
+  u32 E = task->exponent;
+
+  std::optional<Layout> layout;
+  try {
+    layout.emplace(args, device, E, tunedFor(E));
+  } catch (const char*) {
+    // Gpu::make() will report the problem when the task is started.
+    return;
+  }
+  if (!layout->bpwOK()) { return; }
 
-  float bitsPerWord = E / float(N);
+  log("preparing %u in the background\n", E);
+  u32 W = layout->config.width;
+  u32 BIG_H = layout->bigH();
+  u32 SMALL_H = layout->config.height;
+  u32 nW = layout->nW;
+  u32 nH = layout->nH;
+  
+  auto p = make_unique<Prepared>();
+  p->E = E;
+  p->B1 = task->B1;
+  p->B2 = task->B2;
+  p->key = layout->key;
+
+  if (!programs.count(p->key)) {
+    p->program = async(launch::async, [this, clArgs = layout->clArgs, defines = layout->defines]() {
+      return Holder<cl_program>{compile(args, context.get(), device, clArgs, defines)};
+    });
+  }
+  p->weights = async(launch::async, cachedWeights, std::cref(args), E, W, BIG_H, nW);
+  if (p->key != gpuKey) { p->trig = async(launch::async, cachedTrig, std::cref(args), W, BIG_H, SMALL_H, nW, nH); }
+  if (p->B1) {
+    p->powerSmooth = async(launch::async, powerSmoothLSB, E, p->B1);
+    // Only the sieve; the P2 plan itself depends on the GPU memory available at that point.
+    p->primes = async(launch::async, [B1 = p->B1, B2 = p->B2]() { return Pm1Plan::sieve(B1, B2); });
+  }
+  prepared = std::move(p);
+}
+
+Gpu* Gpu::make(u32 E, GpuSession& session, const Variant* variant) {
+  const Args& args = session.args;
+  Layout layout{args, session.device, E, variant ? variant : session.tunedFor(E)};
+  const FFTConfig& config = layout.config;
+  u32 N = layout.N;
+
+  float bitsPerWord = layout.bitsPerWord;
   log("FFT: %s %s (%.2f bpw)\n", numberK(N).c_str(), config.spec().c_str(), bitsPerWord);
 
   if (bitsPerWord > 20) {
@@ -611,13 +967,236 @@ unique_ptr<Gpu> Gpu::make(u32 E, const Args &args) {
 
   if (useLongCarry) { log("using long carry kernels\n"); }
 
-  bool timeKernels = args.timeKernels;
+  const string& key = layout.key;
+
+  unique_ptr<Prepared> prepared = std::move(session.prepared);
+  if (prepared && (prepared->E != E || prepared->key != key)) {
+    // worktodo changed since; drop it.
+    prepared.reset();
+  }
+  if (prepared) { log("using the background preparation\n"); }
+  
+  auto& gpu = session.gpu;
+  if (gpu && session.gpuKey == key) {
+    // Same FFT and same program: keep the buffers, trig tables and kernels, only redo the weights.
+    gpu->setExponent(E, useLongCarry, prepared ? prepared->weights.get() : cachedWeights(args, E, config.width, layout.bigH(), layout.nW));
+    gpu->prepared = std::move(prepared);
+    return gpu.get();
+  }
+
+  // Release the previous GPU buffers before allocating the new ones.
+  gpu.reset();
+  session.gpuKey.clear();
+
+  auto& program = session.programs[key];
+  if (!program) {
+    if (prepared && prepared->program.valid()) {
+      program = prepared->program.get();
+    } else {
+      program.reset(compile(args, session.context.get(), session.device, layout.clArgs, layout.defines));
+    }
+  }
+
+  u32 W = config.width;
+  u32 BIG_H = layout.bigH();
+  u32 SMALL_H = config.height;
+  gpu = make_unique<Gpu>(session, E, W, BIG_H, SMALL_H, layout.nW, layout.nH, program.get(), useLongCarry,
+                         prepared ? prepared->weights.get() : cachedWeights(args, E, W, BIG_H, layout.nW),
+                         (prepared && prepared->trig.valid()) ? prepared->trig.get() : cachedTrig(args, W, BIG_H, SMALL_H, layout.nW, layout.nH));
+  gpu->prepared = std::move(prepared);
+  session.gpuKey = key;
+  return gpu.get();
+}
+
+const Variant* GpuSession::tunedFor(u32 E) const {
+  if (!args.fftSpec.empty()) { return nullptr; }
+  const Variant* variant = tuning.get(getFFTConfig(E, "").fftSize());
+  // A variant with a different middle may not reach as far.
+  return (variant && FFTConfig::fromSpec(variant->spec).maxExp() >= E) ? variant : nullptr;
+}
+
+namespace {
+
+// The groups of alternative -use options tried by -tune; the first option of each group is the default.
+const vector<vector<string>> TUNE_OPTIONS = {
+  {"", "NEW_FFT8", "NEWEST_FFT8"},
+  {"", "OLD_FFT5", "NEWEST_FFT5"},
+  {"", "TRIG_COMPUTE=0", "TRIG_COMPUTE=1"},
+  {"", "UNROLL_WIDTH", "NO_UNROLL_WIDTH"},
+  {"", "OUT_WG=256,OUT_SIZEX=4,OUT_SPACING=1", "OUT_WG=256,OUT_SIZEX=8,OUT_SPACING=2", "OUT_WG=256,OUT_SIZEX=32,OUT_SPACING=4"},
+  {"", "IN_WG=256,IN_SIZEX=4", "IN_WG=256,IN_SIZEX=32"},
+  {"", "NO_ASM"},
+};
+
+vector<string> splitOption(const string& option) {
+  vector<string> flags;
+  size_t start = 0;
+  while (start < option.size()) {
+    size_t end = min(option.find(',', start), option.size());
+    flags.push_back(option.substr(start, end - start));
+    start = end + 1;
+  }
+  return flags;
+}
+
+// The variant with the flags of the option's group replaced by the option.
+Variant withOption(const Variant& base, const vector<string>& group, const string& option) {
+  std::set<string> groupLabels;
+  for (const string& alt : group) { for (const string& flag : splitOption(alt)) { groupLabels.insert(flagLabel(flag)); } }
+  Variant ret{base.spec, {}};
+  for (const string& flag : base.flags) { if (!groupLabels.count(flagLabel(flag))) { ret.flags.push_back(flag); } }
+  for (const string& flag : splitOption(option)) { ret.flags.push_back(flag); }
+  return ret;
+}
+
+}
+
+void GpuSession::tune(u32 E) {
+  u32 fftSize = getFFTConfig(E, args.fftSpec).fftSize();
+  u32 nIters = args.iters ? args.iters : 20'000;
+  log("Tuning FFT %s for %u, %u iterations per variant\n", numberK(fftSize).c_str(), E, nIters);
+
+  // Seconds per iteration; 0 if the variant fails to build or has too much roundoff.
+  auto bench = [&](const Variant& variant, RoundoffStats* roundoff) -> double {
+    try {
+      Gpu* gpu = Gpu::make(E, *this, &variant);
+      Timer timer;
+      RoundoffStats r = gpu->measureRoundoff(nIters);
+      double secsPerIt = timer.deltaSecs() / (nIters + 100);
+      log("%s %s: %.1f us/it, roundoff mean %f, max %f\n",
+          variant.spec.c_str(), variant.flagsString().c_str(), secsPerIt * 1e6, r.mean, r.max);
+      if (r.n < nIters || r.max >= 0.4) { return 0; }
+      if (roundoff) { *roundoff = r; }
+      return secsPerIt;
+    } catch (const char* err) {
+      log("%s %s: %s\n", variant.spec.c_str(), variant.flagsString().c_str(), err);
+      return 0;
+    }
+  };
+
+  Variant best;
+  double bestSecs = 0;
+  RoundoffStats bestRoundoff;
+  for (const FFTConfig& config : FFTConfig::genConfigs()) {
+    if (config.fftSize() != fftSize || config.maxExp() < E) { continue; }
+    Variant variant{config.spec(), {}};
+    RoundoffStats r;
+    double secs = bench(variant, &r);
+    if (secs && (!bestSecs || secs < bestSecs)) {
+      best = variant;
+      bestSecs = secs;
+      bestRoundoff = r;
+    }
+  }
+  if (!bestSecs) {
+    log("No FFT variant of size %s works for %u\n", numberK(fftSize).c_str(), E);
+    throw "tune";
+  }
+
+  // An option must be faster beyond the noise, and not be less accurate: the tuning is applied to all the exponents
+  // of this FFT size, up to its max exponent where there is no roundoff to spare.
+  for (const auto& group : TUNE_OPTIONS) {
+    for (u32 i = 1; i < group.size(); ++i) {
+      Variant variant = withOption(best, group, group[i]);
+      RoundoffStats r;
+      double secs = bench(variant, &r);
+      if (secs && secs < 0.99 * bestSecs && r.mean <= bestRoundoff.mean && r.max <= bestRoundoff.max) {
+        best = variant;
+        bestSecs = secs;
+        bestRoundoff = r;
+      }
+    }
+  }
+
+  log("Tuned FFT %s: %s %s, %.1f us/it\n", numberK(fftSize).c_str(), best.spec.c_str(), best.flagsString().c_str(), bestSecs * 1e6);
+  tuning.set(fftSize, best);
+}
+
+void GpuSession::bench(const string& what) {
+  u32 nIters = args.iters ? args.iters : 10'000;
+  vector<BenchResult> results;
+  size_t start = 0;
+  while (start < what.size()) {
+    size_t end = min(what.find(',', start), what.size());
+    string item = what.substr(start, end - start);
+    start = end + 1;
+    if (item.empty()) { continue; }
+
+    // A FFT spec or size, measured a little below its max exponent; or an exponent, with the FFT chosen as usual.
+    bool isFFT = item.find(':') != string::npos || toupper(item.back()) == 'K' || toupper(item.back()) == 'M';
+    u32 E = 0;
+    Variant variant;
+    if (isFFT) {
+      FFTConfig config = FFTConfig::fromSpec(item);
+      variant = {config.spec(), {}};
+      E = u32(config.maxExp() * 0.99) | 1;
+    } else {
+      bool isNumber = item.size() <= 10 && all_of(item.begin(), item.end(), [](char c) { return isdigit(c); });
+      u64 exp = isNumber ? stoull(item) : 0;
+      if (exp < 2 || exp > u32(-1)) {
+        log("-bench: '%s' is neither an FFT nor an exponent\n", item.c_str());
+        throw "bench";
+      }
+      E = exp;
+      const Variant* tuned = tunedFor(E);
+      variant = tuned ? *tuned : Variant{getFFTConfig(E, args.fftSpec).spec(), {}};
+    }
+
+    log("bench %s %u, %u iterations\n", variant.spec.c_str(), E, nIters);
+    for (BenchResult& r : Gpu::make(E, *this, &variant)->bench(nIters)) {
+      r.fft = variant.spec;
+      results.push_back(std::move(r));
+    }
+  }
+  if (!args.benchOut.empty()) { writeBench(args.benchOut, getLongInfo(device), results); }
+}
+
+void GpuSession::calibrate(const string& what) {
+  vector<FFTConfig> configs = FFTConfig::genConfigs();
+  if (what != "all") {
+    FFTConfig target = FFTConfig::fromSpec(what);
+    bool exact = what.find(':') != string::npos;
+    configs.erase(remove_if(configs.begin(), configs.end(), [&](const FFTConfig& c) {
+      return exact ? c.spec() != target.spec() : c.fftSize() != target.fftSize();
+    }), configs.end());
+  }
+
+  u32 nIters = args.iters ? args.iters : 20'000;
+  for (const FFTConfig& config : configs) {
+    u32 N = config.fftSize();
+    // Around the hand-fitted crossover, mostly below it.
+    float bpw0 = FFTConfig::getMaxExp(N, config.middle) / float(N);
+    vector<pair<float, RoundoffStats>> samples;
+    for (float delta : {-0.4f, -0.3f, -0.2f, -0.1f, 0.0f, 0.1f, 0.2f}) {
+      float bpw = bpw0 + delta;
+      if (bpw > 20) { continue; }
+      u32 E = u32(bpw * N) | 1;
+      Variant variant{config.spec(), {}};
+      RoundoffStats r = Gpu::make(E, *this, &variant)->measureRoundoff(nIters);
+      if (r.n < 2000) {
+        log("No roundoff stats for %s\n", config.spec().c_str());
+        throw "calibrate";
+      }
+      log("%s %u (%.3f bpw): mean %f, SD %f, max %f, pErr %f%%\n",
+          config.spec().c_str(), E, bpw, r.mean, r.sd, r.max, r.pErr(E) * 100);
+      samples.push_back({bpw, r});
+    }
 
-  return make_unique<Gpu>(args, E, WIDTH, SMALL_HEIGHT * MIDDLE, SMALL_HEIGHT, nW, nH,
-                          getDevice(args.device), timeKernels, useLongCarry);
+    float maxBpw = CrossoverTable::fit(N, samples);
+    if (!maxBpw) {
+      log("%s: could not fit the crossover\n", config.spec().c_str());
+      continue;
+    }
+    log("%s: max %.3f bpw (%u) vs. %.3f bpw (%u) hand-fitted\n",
+        config.spec().c_str(), maxBpw, u32(maxBpw * N), bpw0, u32(bpw0 * N));
+    crossovers.set(config, maxBpw);
+  }
 }
 
 vector<u32> Gpu::readAndCompress(ConstBuffer<int>& buf)  {
+  Span span{"read"};
+  if (!hostPack) { return readPacked(buf); }
+
   for (int nRetry = 0; nRetry < 3; ++nRetry) {
     sum64(bufSumOut, u32(buf.size * sizeof(int)), buf);
     
@@ -648,6 +1227,73 @@ vector<u32> Gpu::readAndCompress(ConstBuffer<int>& buf)  {
   throw "Persistent read errors: GPU->Host";
 }
 
+// Like readAndCompress() but the carry resolution and the packing are done on the GPU, and only the compact words
+// are read back.
+vector<u32> Gpu::readPacked(ConstBuffer<int>& buf) {
+  u32 nWords = (E - 1) / 32 + 1;
+  u32 nRead = roundUp(nWords, 2); // sum64 works on u64; the padding is zeroed by packBits.
+  for (int nRetry = 0; nRetry < 3; ++nRetry) {
+    packLast(bufPackCodes, buf);
+    packScan(bufPackBorrow, bufPackCodes, u32(bufPackCodes.size));
+    packDigits(bufAux, bufPackBorrow, buf, E);
+    packBits(bufPacked, bufAux, E);
+    sum64(bufSumOut, u32(nRead * sizeof(u32)), bufPacked);
+
+    vector<u64> expectedVect(1);
+    bufSumOut.readAsync(expectedVect);
+    vector<u32> words = bufPacked.read(nRead);
+    u64 expectedSum = expectedVect[0];
+
+    u64 sum = 0;
+    for (auto it = words.begin(), end = words.end(); it < end; it += 2) { sum += *it | (u64(*(it + 1)) << 32); }
+    bool allZero = std::all_of(words.begin(), words.end(), [](u32 w) { return w == 0; });
+
+    if (sum != expectedSum || (allZero && nRetry == 0)) {
+      log("GPU -> Host read #%d failed (check %x vs %x)\n", nRetry, unsigned(sum), unsigned(expectedSum));
+    } else if (allZero) {
+      log("Read ZERO\n");
+      return {};
+    } else {
+      words.resize(nWords);
+      return words;
+    }
+  }
+  throw "Persistent read errors: GPU->Host";
+}
+
+void Gpu::takeSnapshot() {
+  bufSnapData << bufData;
+  bufSnapCheck << bufCheck;
+}
+
+void Gpu::doCheckAsync(u32 blockSize, Buffer<double>& buf1, Buffer<double>& buf2, Buffer<double>& buf3) {
+  Span span{"check enqueue"};
+  if (!bufSpecData) {
+    bufSpecData.emplace(queue, "specData", N);
+    bufSpecCheck.emplace(queue, "specCheck", N);
+  }
+  *bufSpecData << bufData;
+  modSqLoopMul3(bufAux, bufCheck, 0, blockSize);
+  modMul(bufCheck, bufCheck, bufData, buf1, buf2, buf3);
+  *bufSpecCheck << bufCheck;
+  bufSmallOut.zero(1);
+  u32 sizeBytes = N * sizeof(int);
+  isNotZero(bufSmallOut, sizeBytes, bufCheck);
+  isEqual(bufSmallOut, sizeBytes, bufCheck, bufAux);
+  bufSmallOut.readAsync(specResult, 1);
+}
+
+void Gpu::commitSpeculation() {
+  bufSnapData << *bufSpecData;
+  bufSnapCheck << *bufSpecCheck;
+}
+
+bool Gpu::restoreSnapshot(u64 res) {
+  bufData << bufSnapData;
+  bufCheck << bufSnapCheck;
+  return dataResidue() == res;
+}
+
 vector<u32> Gpu::readCheck() { return readAndCompress(bufCheck); }
 vector<u32> Gpu::readData() { return readAndCompress(bufData); }
 
@@ -721,6 +1367,7 @@ void Gpu::writeState(const vector<u32> &check, u32 blockSize, Buffer<double>& bu
 }
   
 bool Gpu::doCheck(u32 blockSize, Buffer<double>& buf1, Buffer<double>& buf2, Buffer<double>& buf3) {
+  Span span{"check"};
   modSqLoopMul3(bufAux, bufCheck, 0, blockSize);  
   modMul(bufCheck, bufCheck, bufData, buf1, buf2, buf3);  
   return equalNotZero(bufCheck, bufAux);
@@ -732,18 +1379,138 @@ void Gpu::logTimeKernels() {
     queue->clearProfile();
     double total = 0;
     for (auto& p : profile) { total += p.first.total; }
+
+    if (!peakGBps) {
+      peakGBps = measureCopyGBps();
+      log("%u CUs @ %u MHz, copy bandwidth %.0f GB/s%s\n", getComputeUnits(device), getMaxClockMHz(device), peakGBps,
+          args.peakFlops ? (", peak " + to_string(args.peakFlops) + " GFLOP/s").c_str() : "");
+    }
+
+    // With a FLOP peak, the roofline's ridge point: kernels below this FLOP/byte are bound by the memory.
+    double ridge = args.peakFlops ? args.peakFlops / peakGBps : 0;
   
     for (auto& [stats, name]: profile) {
       float percent = 100 / total * stats.total;
       if (percent >= .01f) {
-        log("%5.2f%% %-14s : %6.0f us/call x %5d calls\n",
-            percent, name.c_str(), stats.total * (1e6f / stats.n), stats.n);
+        double secsPerCall = stats.total / stats.n;
+        string rates;
+        if (const KernelCost* cost = findCost(name)) {
+          double gbps = cost->bytes() / secsPerCall * 1e-9;
+          double intensity = cost->flops / cost->bytes();
+          char buf[128];
+          snprintf(buf, sizeof(buf), " %6.0f GB/s (%3.0f%%) %6.0f GFLOP/s %4.1f F/B%s",
+                   gbps, gbps / peakGBps * 100, cost->flops / secsPerCall * 1e-9, intensity,
+                   ridge ? (intensity < ridge ? " mem" : " alu") : "");
+          rates = buf;
+        }
+        log("%5.2f%% %-14s : %6.0f us/call x %5d calls%s\n",
+            percent, name.c_str(), secsPerCall * 1e6, stats.n, rates.c_str());
       }
     }
     log("Total time %.3f s\n", total);
   }
 }
 
+// The mean time per call of the top kernels, with the 95% confidence interval, from the launches sampled since the
+// previous call. Empty if not sampling.
+string Gpu::kernelSummary() {
+  if (!queue->isSampling()) { return ""; }
+  Queue::Profile profile = queue->getProfile();
+  queue->clearProfile();
+  string ret;
+  for (u32 i = 0; i < profile.size() && i < 5; ++i) {
+    auto& [stats, name] = profile[i];
+    char buf[128];
+    snprintf(buf, sizeof(buf), " %s %.0f+-%.0f", name.c_str(), stats.mean() * 1e6, stats.ci95() * 1e6);
+    ret += buf;
+  }
+  return ret.empty() ? ret : " |" + ret;
+}
+
+// Host time per iteration to enqueue the squarings: setting all the kernel arguments at every launch as before,
+// with the arguments cached in the Kernel, and replaying steadySquaring. Also the wall time, including the GPU.
+void Gpu::benchHost(u32 nIters) {
+  writeIn(bufData, makeWords(E, 3));
+  fftP(buf2, bufData);
+  tW(buf1, buf2);
+  finish();
+
+  vector<Kernel*> kernels{&tailFusedSquare, &fftMiddleOut, &carryFused, &fftMiddleIn};
+  auto steady = [&](bool unbind) {
+    if (unbind) { for (Kernel* k : kernels) { k->unbind(); } }
+    coreStep(bufData, bufData, false, false, false);
+  };
+
+  const char* names[] = {"set args", "cached args", "replay"};
+  log("host overhead at FFT %u, %u iterations (us per iteration):\n", N, nIters);
+  for (u32 variant = 0; variant < 3; ++variant) {
+    Timer timer;
+    if (variant == 2) {
+      steadySquaring.run(nIters);
+    } else {
+      for (u32 i = 0; i < nIters; ++i) { steady(variant == 0); }
+    }
+    double secsEnqueue = timer.deltaSecs();
+    finish();
+    double secsTotal = secsEnqueue + timer.deltaSecs();
+    log("%-12s enqueue %7.2f, wall %8.2f\n", names[variant], secsEnqueue * 1e6 / nIters, secsTotal * 1e6 / nIters);
+  }
+}
+
+vector<BenchResult> Gpu::bench(u32 nIters) {
+  vector<BenchResult> results;
+
+  // bytes: the memory traffic of one call, 0 if not estimated.
+  auto time = [&](const string& what, u32 calls, double bytes, auto&& op) {
+    finish();
+    queue->clearProfile();
+    Timer timer;
+    op();
+    finish();
+    double secs = timer.elapsedSecs();
+    results.push_back({"", E, what, calls, secs * 1e6 / calls, bytes ? bytes * calls / secs * 1e-9 : 0});
+    log("%-16s %8.1f us/call x %u\n", what.c_str(), secs * 1e6 / calls, calls);
+    for (auto& [stats, name] : queue->getProfile()) {
+      const KernelCost* cost = findCost(name);
+      results.push_back({"", E, what + '/' + name, stats.n, stats.mean() * 1e6, cost ? cost->bytes() / stats.mean() * 1e-9 : 0});
+    }
+    queue->clearProfile();
+  };
+
+  // A squaring streams the N doubles through memory in and out of each of its 4 kernels.
+  double squaringBytes = 4 * 2 * N * sizeof(double);
+  // The residue crosses the bus packed, or as N ints with HOST_PACK.
+  double transferBytes = hostPack ? N * sizeof(int) : (E - 1) / 32 * 4 + 4;
+
+  Words words = makeWords(E, 3);
+  writeIn(bufData, words);
+  modSqLoop(bufData, 0, 100);
+  bufCheck << bufData;
+
+  time("modSqLoop", nIters, squaringBytes, [&]() { modSqLoop(bufData, 0, nIters); });
+  u32 nMul = max(nIters / 10, 1u);
+  time("modMul", nMul, 0, [&]() { for (u32 i = 0; i < nMul; ++i) { modMul(bufData, bufData, bufCheck, buf1, buf2, buf3); } });
+  u32 nExp = max(nIters / 1000, 1u);
+  time("exponentiate", nExp, 0, [&]() { for (u32 i = 0; i < nExp; ++i) { exponentiate(bufCheck, u64(-1) >> 1, buf1, buf2, buf3); } });
+  {
+    vector<Buffer<int>> bufs = makeBufVector(8);
+    for (auto& buf : bufs) { buf << bufData; }
+    time("fold(8)", 10, 0, [&]() { for (u32 i = 0; i < 10; ++i) { fold(bufs); } });
+  }
+  time("readAndCompress", 10, transferBytes, [&]() { for (u32 i = 0; i < 10; ++i) { words = readAndCompress(bufData); } });
+  time("writeIn", 10, transferBytes, [&]() { for (u32 i = 0; i < 10; ++i) { writeIn(bufData, words); } });
+  return results;
+}
+
+RoundoffStats Gpu::measureRoundoff(u32 nIters) {
+  writeIn(bufData, makeWords(E, 3));
+  // Let the residue grow to full size before measuring.
+  modSqLoop(bufData, 0, 100);
+  readRoundoff();
+  modSqLoop(bufData, 0, nIters);
+  return readRoundoff();
+}
+
 void Gpu::tW(Buffer<double>& out, Buffer<double>& in) {
   fftMiddleIn(out, in);
 }
@@ -768,7 +1535,15 @@ vector<int> Gpu::readOut(ConstBuffer<int> &buf) {
   return bufAux.read();
 }
 
-void Gpu::writeIn(Buffer<int>& buf, const vector<u32>& words) { writeIn(buf, expandBits(words, N, E)); }
+void Gpu::writeIn(Buffer<int>& buf, const vector<u32>& words) {
+  if (hostPack) {
+    writeIn(buf, expandBits(words, N, E));
+  } else {
+    assert(words.size() == (E - 1) / 32 + 1);
+    bufPacked.write(words);
+    unpackBits(buf, bufPacked, E);
+  }
+}
 
 void Gpu::writeIn(Buffer<int>& buf, const vector<i32>& words) {
   bufAux.write(words);
@@ -803,16 +1578,15 @@ void spin() {
 
 }
 
-Words Gpu::expExp2(const Words& A, u32 n) {
+void Gpu::expExp2(Buffer<i32>& A, u32 n) {
   u32 blockSize = 400;
   u32 logStep = 20000;
   
-  writeData(A);
   IterationTimer timer{0};
   u32 k = 0;
   while (true) {
     u32 its = std::min(blockSize, n - k);
-    modSqLoop(bufData, 0, its);
+    modSqLoop(A, 0, its);
     k += its;
     spin();
     queue->finish();
@@ -820,7 +1594,6 @@ Words Gpu::expExp2(const Words& A, u32 n) {
     if (k % logStep == 0) { log("%u / %u, %.0f us/it\n", k, n, secsPerIt * 1'000'000); }
     if (k >= n) { break; }
   }
-  return readData();
 }
 
 // A:= A^h * B
@@ -829,18 +1602,10 @@ void Gpu::expMul(Buffer<i32>& A, u64 h, Buffer<i32>& B) {
   modMul(A, A, B, buf1, buf2, buf3);
 }
 
-// return A^x * B
-Words Gpu::expMul(const Words& A, u64 h, const Words& B) {
-  writeData(A);
-  writeCheck(B);
-  expMul(bufData, h, bufCheck);
-  return readData();
-}
-
-Words Gpu::expMul2(const Words& A, u64 h, const Words& B) {
+// A:= A^h * B^2
+void Gpu::expMul2(Buffer<i32>& A, u64 h, Buffer<i32>& B) {
   expMul(A, h, B);
-  modMul(bufData, bufData, bufCheck, buf1, buf2, buf3);
-  return readData();
+  modMul(A, A, B, buf1, buf2, buf3);
 }
 
 void Gpu::exponentiate(Buffer<int>& bufInOut, u64 exp, Buffer<double>& buf1, Buffer<double>& buf2, Buffer<double>& buf3) {
@@ -878,32 +1643,111 @@ void Gpu::exponentiateLow(Buffer<double>& out, const Buffer<double>& base, u64 e
 
 namespace {
 bool testBit(u64 x, int bit) { return x & (u64(1) << bit); }
+
+constexpr u32 MAX_WINDOW = 4;
+
+// The window size that minimizes the multiplications for an exponent of nBits: 2^(k-1) odd powers to precompute
+// (one squaring and 2^(k-1)-1 multiplications), then about nBits/(k+1) multiplications. The squarings are the same for any k.
+u32 windowBits(u32 nBits, u32 maxWindow) {
+  u32 best = 1;
+  double bestCost = nBits / 2.0;
+  for (u32 k = 2; k <= maxWindow && k < nBits; ++k) {
+    double cost = (1u << (k - 1)) + nBits / double(k + 1);
+    if (cost < bestCost) {
+      best = k;
+      bestCost = cost;
+    }
+  }
+  return best;
 }
 
-// See "left-to-right binary exponentiation" on wikipedia
-void Gpu::exponentiateCore(Buffer<double>& out, const Buffer<double>& base, u64 exp, Buffer<double>& tmp) {
-  assert(exp >= 2);
+}
 
-  tailSquareLow(tmp, base);
-  tH(out, tmp);
+// The powers base^3, base^5, .. base^(2^k-1) needed by a window of k bits, in "low" position.
+// They are taken from the AllocTrac budget (leaving a few buffers spare) and the window is made smaller when there is no room;
+// with k = 1 none are needed.
+u32 Gpu::makeOddPowers(vector<Buffer<double>>& bufPowers, u32 k) {
+  const u32 SPARE = 2;
+  size_t bufSize = N * sizeof(double);
+  size_t nFree = AllocTrac::availableBytes() / bufSize;
+  if (hasFreeMemInfo(device)) { nFree = min(nFree, size_t(getFreeMem(device) / bufSize)); }
+  u32 nRoom = nFree > SPARE ? nFree - SPARE : 0;
   
-  int p = 63;
-  while (!testBit(exp, p)) { --p; }
+  while (k > 1 && (1u << (k - 1)) - 1 > nRoom) { --k; }
   
-  for (--p; ; --p) {
-    if (testBit(exp, p)) {
-      doCarry(tmp, out);
-      tW(out, tmp);
-      tailFusedMulLow(tmp, out, base);
-      tH(out, tmp);
+  u32 nPowers = (1u << (k - 1)) - 1;
+  while (bufPowers.size() < nPowers) {
+    bufPowers.emplace_back(queue, "pow"s + to_string(2 * bufPowers.size() + 3), N);
+  }
+  return k;
+}
+
+// Left-to-right sliding-window exponentiation, see "Handbook of Applied Cryptography" 14.85.
+// With k = 1 this is the plain left-to-right binary exponentiation.
+void Gpu::exponentiateCore(Buffer<double>& out, const Buffer<double>& base, u64 exp, Buffer<double>& tmp) {
+  assert(exp >= 2);
+
+  int top = 63;
+  while (!testBit(exp, top)) { --top; }
+
+  // The top window must not reach bit 0, see below.
+  // Released on return, so they don't hold on to the B1/P2 budget.
+  vector<Buffer<double>> bufPowers;
+  u32 k = makeOddPowers(bufPowers, windowBits(top + 1, MAX_WINDOW));
+
+  vector<const Buffer<double>*> powers{&base};
+  if (k > 1) {
+    // out = base^2, in "low" position.
+    tailSquareLow(out, base);
+    tH(tmp, out);
+    doCarry(out, tmp);
+    tW(tmp, out);
+    fftHin(out, tmp);
+    for (u32 i = 0; i < (1u << (k - 1)) - 1; ++i) {
+      bufPowers[i] << *powers.back();
+      multiplyLowLow(bufPowers[i], out, tmp);
+      powers.push_back(&bufPowers[i]);
     }
-    
-    if (!p) { break; }
+  }
 
+  // The odd window ending at the set bit i: returns its lowest bit, and its value in v.
+  auto window = [&](int i, u32& v) {
+    int j = max(i - int(k) + 1, 0);
+    while (!testBit(exp, j)) { ++j; }
+    v = (exp >> j) & ((u64(1) << (i - j + 1)) - 1);
+    return j;
+  };
+
+  auto square = [&]() {
     doCarry(tmp, out);
     tW(out, tmp);
     tailSquare(tmp, out);
     tH(out, tmp);
+  };
+
+  u32 v = 0;
+  int i = window(top, v) - 1;
+
+  // out = base^(2v): the first squaring of the rest is folded in, which is why the top window must end above bit 0.
+  tailSquareLow(tmp, *powers[v / 2]);
+  tH(out, tmp);
+  bool squared = true;
+
+  while (i >= 0) {
+    if (!testBit(exp, i)) {
+      if (squared) { squared = false; } else { square(); }
+      --i;
+      continue;
+    }
+
+    int j = window(i, v);
+    for (int s = i - j + 1 - squared; s > 0; --s) { square(); }
+    squared = false;
+    doCarry(tmp, out);
+    tW(out, tmp);
+    tailFusedMulLow(tmp, out, *powers[v / 2]);
+    tH(out, tmp);
+    i = j - 1;
   }
 }
 
@@ -942,6 +1786,13 @@ void Gpu::coreStep(Buffer<int>& out, Buffer<int>& in, bool leadIn, bool leadOut,
 
 u32 Gpu::modSqLoop(Buffer<int>& io, u32 from, u32 to) {
   assert(from <= to);
+  if (!useLongCarry && to - from >= 2) {
+    coreStep(io, io, true, false, false);
+    steadySquaring.run(to - from - 2);
+    coreStep(io, io, false, true, false);
+    return to;
+  }
+
   bool leadIn = true;
   for (u32 k = from; k < to; ++k) {
     bool leadOut = useLongCarry || (k == to - 1);
@@ -1051,15 +1902,6 @@ void Gpu::doDiv9(u32 E, Words& words) {
 }
 
 namespace {
-u32 checkStepForErrors(u32 argsCheckStep, u32 nErrors) {
-  if (argsCheckStep) { return argsCheckStep; }  
-  switch (nErrors) {
-    case 0:  return 200'000;
-    case 1:  return 100'000;
-    default: return  50'000;
-  }
-}
-
 template<typename To, typename From> To pun(From x) {
   static_assert(sizeof(To) == sizeof(From));
   union {
@@ -1072,58 +1914,61 @@ template<typename To, typename From> To pun(From x) {
 
 template<typename T> float asFloat(T x) { return pun<float>(x); }
 
+// The upper edge of the roundoff histogram bin.
+float roundoffBinEnd(u32 bin) { return asFloat((bin + ROUNDOFF_BIN0 + 1) << 19); }
+
 }
 
-void Gpu::printRoundoff(u32 E) {
-  u32 roundN = bufRoundoff.read(1)[0];
-  // fprintf(stderr, "roundN %u\n", roundN);
+RoundoffStats Gpu::readRoundoff() {
+  // The kernels reduce the roundoff to a histogram plus moments on the GPU, so only a few words are read back.
+  vector<u32> stats;
+  bufRoundoff.readAsync(stats);
+  bufRoundoff.zero();
+  queue->finish();
 
-  vector<u32> carry;
-  vector<u32> carryMul;
-  bufCarryMax.readAsync(carry, 4);
-  bufCarryMulMax.readAsync(carryMul, 4);
-  
-  vector<u32> roundVect;
-  bufRoundoff.readAsync(roundVect, roundN, 8);
-    
-  vector<u32> zero{0, 0, 0, 0};
-  bufRoundoff.write(zero);
-  bufCarryMax.write(zero);
-  bufCarryMulMax.write(zero);
+  u32 n = stats[0];
+  if (!n) { return {}; }
+
+  const u32* hist = &stats[8];
 
-  if (!roundN) { return; }
-  if (roundN < 2000) { return; }
-  
 #if DUMP_STATS
   {
     File fo = File::openAppend("roundoff.txt");
-    if (fo) { for (u32 x : roundVect) { fprintf(fo.get(), "%f\n", asFloat(x)); } }
+    if (fo) { for (u32 i = 0; i < ROUNDOFF_BINS; ++i) { fprintf(fo.get(), "%f %u\n", roundoffBinEnd(i), hist[i]); } }
   }
 #endif
 
-  double sum = 0;
-  for (u32 x : roundVect) { sum += asFloat(x); }
-  double avg = sum / roundN;
-  double variance = 0;
-  double m = 0;
-  for (u32 u : roundVect) {
-    double x = asFloat(u);
-    m = max(m, x);
-    double d = x - avg;
-    variance += d * d;
-  }
-  
-  variance /= roundN;
-  double sdev = sqrt(variance);
-  
-  double gamma = 0.577215665; // Euler-Mascheroni
-  double z = (0.5 - avg) / sdev;
+  // The 64-bit sums, in 32.32 fixed point, each over two words.
+  u64 fixedSum = 0, fixedSumSq = 0;
+  memcpy(&fixedSum, &stats[4], sizeof(fixedSum));
+  memcpy(&fixedSumSq, &stats[6], sizeof(fixedSumSq));
+  double sum = fixedSum * 0x1p-32;
+  double sumSq = fixedSumSq * 0x1p-32;
+  double mean = sum / n;
+  double max = asFloat(stats[3]);
 
-  // See Gumbel distribution https://en.wikipedia.org/wiki/Gumbel_distribution
-  double p = -expm1(-exp(-z * (M_PI / sqrt(6))) * (E * exp(-gamma))); 
-  
-  log("Roundoff: N=%u, mean %f, SD %f, CV %f, max %f, z %.1f (pErr %f%%)\n",
-      roundN, avg, sdev, sdev / avg, m, z, p * 100);
+  // The upper bound of the 99.9th percentile.
+  u32 nBelow = 0;
+  u32 bin = 0;
+  while (bin < ROUNDOFF_BINS - 1 && (nBelow += hist[bin]) < n - n / 1000) { ++bin; }
+
+  return {n, mean, sqrt(std::max(0.0, sumSq / n - mean * mean)), max, std::min(double(roundoffBinEnd(bin)), max)};
+}
+
+void Gpu::printRoundoff(u32 E) {
+  vector<u32> carry;
+  vector<u32> carryMul;
+  bufCarryMax.readAsync(carry, 4);
+  bufCarryMulMax.readAsync(carryMul, 4);
+  bufCarryMax.zero();
+  bufCarryMulMax.zero();
+
+  RoundoffStats r = readRoundoff();
+  if (r.n < 2000) { return; }
+
+  double z = (0.5 - r.mean) / r.sd;
+  log("Roundoff: N=%u, mean %f, SD %f, CV %f, p99.9 %f, max %f, z %.1f (pErr %f%%)\n",
+      r.n, r.mean, r.sd, r.sd / r.mean, r.p999, r.max, z, r.pErr(E) * 100);
 
   // #if 0
   u32 carryN = carry[3];
@@ -1280,6 +2125,7 @@ void Gpu::doP2(Saver* saver, u32 b1, u32 b2, future<string>& gcdFuture, Signal &
   u32 nBuf = AllocTrac::availableBytes() / bufSize - 5;
   u32 D = Pm1Plan::getD(args.D, nBuf);
   LogContext pushContext{"P2("s + formatBound(b1) + ',' + formatBound(b2) + ")"};
+  Span span{"P2"};
 
   if (saver->loadP2(b2, D, nBuf) == u32(-1)) {
     // log("already finished\n");
@@ -1288,7 +2134,7 @@ void Gpu::doP2(Saver* saver, u32 b1, u32 b2, future<string>& gcdFuture, Signal &
 
   log("D=%u, nBuf=%u\n", D, nBuf);
     
-  Pm1Plan plan{args.D, nBuf, b1, b2};
+  Pm1Plan plan{args.D, nBuf, b1, b2, takePrimes(b1, b2)};
   
   log("Generating P2 plan, please wait..\n");
   auto [beginBlock, selected] = plan.makePlan();
@@ -1336,7 +2182,10 @@ void Gpu::doP2(Saver* saver, u32 b1, u32 b2, future<string>& gcdFuture, Signal &
   
     assert(!gcdFuture.valid());
     log("Starting P1 GCD\n");
-    gcdFuture = async(launch::async, [E=E, p1Data]() { return GCD(E, p1Data, 1); });
+    gcdFuture = async(launch::async, [E=E, p1Data]() {
+      Span span{"P1 GCD", "async"};
+      return GCD(E, p1Data, 1);
+    });
   }
 
   vector<u64> blockChecksum(blockBufs.size());
@@ -1509,6 +2358,7 @@ void Gpu::doP2(Saver* saver, u32 b1, u32 b2, future<string>& gcdFuture, Signal &
       assert(!gcdFuture.valid());
       const u32 nextBlock = atEnd ? u32(-1) : (block + 1);
       gcdFuture = async(launch::async, [E=E, b2, D, nBuf, nextBlock, p2Data=std::move(p2Data), saver]() {
+        Span span{"P2 GCD", "async"};
         string factor = GCD(E, p2Data, 0);
         saver->saveP2(b2, D, nBuf, nextBlock);
         return factor;
@@ -1530,6 +2380,7 @@ struct JacobiResult {
 };
 
 JacobiResult doJacobiCheck(u32 E, const Words& data, u32 k) {
+  Span span{"Jacobi", "async"};
   return {jacobi(E, data) == 1, k, res64(data)};
 }
 
@@ -1573,21 +2424,35 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
   u32 power = -1;
   u32 startK = 0;
 
+  // Left over from the previous test, if it speculated; not to be held through this test's B1 and P2.
+  bufSpecData.reset();
+  bufSpecCheck.reset();
+
   Saver saver{E, args.nSavefiles, b1, args.startFrom};
-  B1Accumulator b1Acc{this, &saver, E};
+  B1Accumulator b1Acc{this, &saver, E, takePowerSmooth(b1)};
   future<string> gcdFuture;
   future<JacobiResult> jacobiFuture;
   Signal signal;
 
   // Used to detect a repetitive failure, which is more likely to indicate a software rather than a HW problem.
-  std::optional<u64> lastFailedRes64;
+  u64 lastFailedRes64 = 0; // 0: no failed check to compare with
 
   // Number of sequential errors (with no success in between). If this ever gets high enough, stop.
   int nSeqErrors = 0;
+
+  u32 lastCheckK = 0;
+
+  // The iteration and res64 of the in-VRAM snapshot, 0 if none.
+  u32 snapK = 0;
+  u64 snapRes = 0;
+
+  TraceFile traceFile;
+  u32 traceEndK = 0; // the trace of this run covers [startK, traceEndK)
   
  reload:
+  snapK = 0;
   {
-    PRPState loaded = saver.loadPRP(args.blockSize);
+    PRPState loaded = saver.loadPRP(args.blockSize ? args.blockSize : CheckPolicy::blockSize(session.checkPolicy.checkStep()));
     b1Acc.load(loaded.k);
     
     writeState(loaded.check, loaded.blockSize, buf1, buf2, buf3);
@@ -1598,7 +2463,7 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
       // On the OK branch do not clear lastFailedRes64 -- we still want to compare it with the GEC check.
     } else {
       log("EE %9u on-load: %016" PRIx64 " vs. %016" PRIx64 "\n", loaded.k, res, loaded.res64);
-      if (lastFailedRes64 && res == *lastFailedRes64) {
+      if (lastFailedRes64 && res == lastFailedRes64) {
         throw "error on load";
       }
       lastFailedRes64 = res;
@@ -1606,6 +2471,7 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
     
     k = loaded.k;
+    lastCheckK = k;
     blockSize = loaded.blockSize;
     if (nErrors == 0) { nErrors = loaded.nErrors; }
     assert(nErrors >= loaded.nErrors);
@@ -1621,13 +2487,19 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
 
   assert(blockSize > 0 && 10000 % blockSize == 0);
   
-  u32 checkStep = checkStepForErrors(args.logStep, nErrors);
+  u32 checkStep = args.logStep ? args.logStep : session.checkPolicy.checkStep();
   assert(checkStep % 10000 == 0);
 
   if (!startK) { startK = k; }
+  if (args.trace && !traceEndK) {
+    traceEndK = startK + args.trace;
+    traceFile.start(fs::path{to_string(E)} / ("trace-" + to_string(startK) + ".json"));
+  }
 
+  bool verifyProof = false;
   if (power == u32(-1)) {
     power = ProofSet::effectivePower(args.tmpDir, E, args.proofPow, startK);
+    verifyProof = power && startK;
     if (!power) {
       log("Proof disabled because of missing checkpoints\n");
     } else if (power != args.proofPow) {
@@ -1639,6 +2511,15 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
   
   ProofSet proofSet{args.tmpDir, E, power};
 
+  // The power was chosen from the manifest; read back the residues in the background.
+  future<bool> proofVerify;
+  if (verifyProof) {
+    proofVerify = async(launch::async, [&proofSet, startK]() {
+      Span span{"proof verify", "async"};
+      return proofSet.verifyTo(startK);
+    });
+  }
+
   bool isPrime = false;
   IterationTimer iterationTimer{startK};
 
@@ -1665,6 +2546,55 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
   assert(checkStep % blockSize == 0);
 
   bool didP2 = false;
+
+  // Speculation: at a check, the check is only enqueued and the squaring continues. The result is looked at
+  // after the next sync, and on failure the loop rolls back like for a synchronous check.
+  bool speculate = !args.flags.count("NO_SPECULATE");
+  u32 specK = 0; // the iteration of the pending speculative check, 0 if none
+  u64 specRes = 0;
+  Words specCheck;
+  float specSecsPerIt = 0, specSecsCheck = 0;
+
+  auto learnCheck = [&](u32 checkK, bool ok, float secsPerIt, float secsCheck, float secsSave) {
+    session.checkPolicy.checked(checkK - lastCheckK, ok, secsPerIt, secsCheck, secsSave);
+    lastCheckK = checkK;
+    if (!args.logStep) {
+      u32 step = session.checkPolicy.checkStep();
+      if (step != checkStep) {
+        log("check step %u (error rate %.2g per million iterations)\n", step, session.checkPolicy.errorRate() * 1e6);
+        checkStep = step;
+      }
+    }
+  };
+
+  // Throws if the errors look persistent.
+  auto checkFailed = [&](u32 checkK, u64 checkRes) {
+    learnCheck(checkK, false, 0, 0, 0);
+    ++nErrors;
+    if (++nSeqErrors > 2) {
+      log("%d sequential errors, will stop.\n", nSeqErrors);
+      throw "too many errors";
+    }
+    if (lastFailedRes64 && checkRes == lastFailedRes64) {
+      log("Consistent error %016" PRIx64 ", will stop.\n", checkRes);
+      throw "consistent error";
+    }
+    lastFailedRes64 = checkRes;
+  };
+
+  // On the first error after an OK check roll back in VRAM, unless the P-1 accumulators would need rolling back too.
+  // A second error in a row may come from a bad snapshot, so reload from disk then (when this returns false).
+  auto rollBack = [&]() {
+    if (!(snapK && nSeqErrors == 1 && !b1Acc.wantK() && restoreSnapshot(snapRes))) { return false; }
+    log("Rolled back to %u\n", snapK);
+    k = snapK;
+    lastCheckK = k;
+    skipNextCheckUpdate = true;
+    leadIn = true;
+    persistK = proofSet.next(k);
+    iterationTimer.reset(k);
+    return true;
+  };
   
   while (true) {
     assert(k < kEndEnd);
@@ -1680,6 +2610,12 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
         }
       }
     }
+
+    if (finished(proofVerify) && !proofVerify.get()) {
+      log("Proof residues corrupted, choosing the proof power again\n");
+      power = -1;
+      goto reload;
+    }
     
     if (skipNextCheckUpdate) {
       skipNextCheckUpdate = false;
@@ -1714,8 +2650,14 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
         ++nErrors;
         goto reload;
       }
-      proofSet.save(k, data);
+      {
+        Span span{"proof save"};
+        proofSet.save(k, data);
+      }
       persistK = proofSet.next(k);
+      for (u32 failedK : proofSet.takeWriteFailures()) {
+        log("Could not write proof residue %u, keeping it in memory -- hurry make space!\n", failedK);
+      }
     }
 
     if (k == kEnd) {
@@ -1744,14 +2686,44 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
     }
 
     u64 res = dataResidue(); // implies finish()
+
+    // Past the traced iterations the queue stops retaining the launch events.
+    if (traceFile && k >= traceEndK) { traceFile.stop(); }
+
+    if (specK) {
+      // The finish() above also completed the read of the speculative check's result.
+      u32 checkK = std::exchange(specK, 0);
+      if (speculativeCheckOK()) {
+        nSeqErrors = 0;
+        lastFailedRes64 = 0;
+        saver.savePRP(PRPState{checkK, blockSize, specRes, std::move(specCheck), nErrors});
+        commitSpeculation();
+        snapK = checkK;
+        snapRes = specRes;
+        doBigLog(E, checkK, specRes, true, specSecsPerIt, specSecsCheck, 0, kEndEnd, nErrors, b1Acc.nBits, b1Acc.b1, 0);
+        learnCheck(checkK, true, specSecsPerIt, specSecsCheck, 0);
+        // Here rather than when the check was enqueued, as the queue is finished now.
+        logTimeKernels();
+      } else {
+        doBigLog(E, checkK, specRes, false, specSecsPerIt, specSecsCheck, 0, kEndEnd, nErrors, b1Acc.nBits, b1Acc.b1, 0);
+        checkFailed(checkK, specRes);
+        if (rollBack()) { continue; }
+        goto reload;
+      }
+    }
+
     bool doCheck = !res || doStop || b1JustFinished || (k % checkStep == 0) || (k >= kEndEnd) || (k - startK == 2 * blockSize);
       
     if (k % 10000 == 0 && !doCheck) {
       float secsPerIt = iterationTimer.reset(k);
       // log("   %9u %6.2f%% %s %4.0f us/it\n", k, k / float(kEndEnd) * 100, hex(res).c_str(), secsPerIt * 1'000'000);
-      log("%9u %s %4.0f\n", k, hex(res).c_str(), secsPerIt * 1'000'000);
+      log("%9u %s %4.0f%s\n", k, hex(res).c_str(), secsPerIt * 1'000'000, kernelSummary().c_str());
+      if (printStats) { printRoundoff(E); }
     }
       
+    // Near the end, let the CPU get the next task ready while the GPU finishes this one.
+    if (k % 10000 == 0 && k + 200'000 >= kEnd) { session.prepareNext(task); }
+
     if (doStop) {
       log("Stopping, please wait..\n");
       signal.release();
@@ -1776,13 +2748,26 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
       Words check = readCheck();
       if (check.empty()) { log("Check read ZERO\n"); }
 
+      // Only plain PRP checks are speculative: the P-1 steps and the end of the test need the check's result right away.
+      if (speculate && !check.empty() && res && !doStop && !b1JustFinished && k < kEnd && didP2 && !b1Acc.wantK()) {
+        doCheckAsync(blockSize, buf1, buf2, buf3);
+        specK = k;
+        specRes = res;
+        specCheck = std::move(check);
+        specSecsPerIt = secsPerIt;
+        // The check's squarings run on the GPU after the host returns; count them as blockSize iterations.
+        specSecsCheck = iterationTimer.reset(k) + blockSize * secsPerIt;
+        skipNextCheckUpdate = true;
+        continue;
+      }
+
       bool ok = !check.empty() && this->doCheck(blockSize, buf1, buf2, buf3);
 
       float secsCheck = iterationTimer.reset(k);
         
       if (ok) {
         nSeqErrors = 0;
-        lastFailedRes64.reset();
+        lastFailedRes64 = 0;
         skipNextCheckUpdate = true;
 
         Words b1Data;
@@ -1792,11 +2777,16 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
           goto reload;
         }
 
-        if (k < kEnd) { saver.savePRP(PRPState{k, blockSize, res, check, nErrors}); }
+        if (k < kEnd) { saver.savePRP(PRPState{k, blockSize, res, std::move(check), nErrors}); }
+
+        takeSnapshot();
+        snapK = k;
+        snapRes = res;
 
         float secsSave = iterationTimer.reset(k);
           
         doBigLog(E, k, res, ok, secsPerIt, secsCheck, secsSave, kEndEnd, nErrors, b1Acc.nBits, b1Acc.b1, ::res64(b1Data));
+        learnCheck(k, true, secsPerIt, secsCheck, secsSave);
 
         if (!b1Data.empty() && (!b1Acc.wantK() || (k % 1'000'000 == 0)) && !jacobiFuture.valid()) {
           // log("P1 %9u starting Jacobi check\n", k);
@@ -1815,17 +2805,11 @@ PRPResult Gpu::isPrimePRP(const Args &args, const Task& task) {
         
       } else {
         doBigLog(E, k, res, ok, secsPerIt, secsCheck, 0, kEndEnd, nErrors, b1Acc.nBits, b1Acc.b1, 0);
-        ++nErrors;
-        if (++nSeqErrors > 2) {
-          log("%d sequential errors, will stop.\n", nSeqErrors);
-          throw "too many errors";
-        }
-        if (lastFailedRes64 && res == *lastFailedRes64) {
-          log("Consistent error %016" PRIx64 ", will stop.\n", res);
-          throw "consistent error";
+        checkFailed(k, res);
+        if (!doStop) {
+          if (rollBack()) { continue; }
+          goto reload;
         }
-        lastFailedRes64 = res;
-        if (!doStop) { goto reload; }
       }
         
       logTimeKernels();
@@ -8,6 +8,10 @@
 
 #include "common.h"
 #include "kernel.h"
+#include "CheckPolicy.h"
+#include "Crossover.h"
+#include "Tune.h"
+#include "Bench.h"
 
 #include <vector>
 #include <string>
@@ -16,10 +20,15 @@
 #include <atomic>
 #include <future>
 #include <filesystem>
+#include <map>
+#include <optional>
 
 struct PRPResult;
 struct PRPState;
 struct Task;
+struct Weights;
+struct Trig;
+struct Prepared;
 
 class Args;
 class Saver;
@@ -44,6 +53,8 @@ struct PRPResult {
 struct Reload {
 };
 
+class GpuSession;
+
 class Gpu {
   friend struct SquaringSet;
   u32 E;
@@ -53,10 +64,12 @@ class Gpu {
   u32 WIDTH;
   bool useLongCarry;
   bool timeKernels;
+  bool hostPack;  // compactBits()/expandBits() on the host instead of the pack/unpack kernels
 
+  GpuSession& session;
   cl_device_id device;
-  Context context;
-  Holder<cl_program> program;
+  const Context& context;
+  cl_program program;  // owned by the GpuSession
   QueuePtr queue;
   
   Kernel carryFused;
@@ -88,21 +101,42 @@ class Gpu {
   Kernel isNotZero;
   Kernel isEqual;
   Kernel sum64;
+
+  Kernel packLast;
+  Kernel packScan;
+  Kernel packDigits;
+  Kernel packBits;
+  Kernel unpackBits;
   
   // Kernel testKernel;
 
+  KernelSequence steadySquaring;
+
+  vector<Kernel*> costedKernels; // the kernels with a KernelCost set
+  double peakGBps = 0;           // measured on first use
+
   // Trigonometry constant buffers, used in FFTs.
   ConstBuffer<double2> bufTrigW;
   ConstBuffer<double2> bufTrigH;
   ConstBuffer<double2> bufTrigM;
 
-  ConstBuffer<u32> bufBits;  // bigWord bits aligned for CarryFused/fftP
-  ConstBuffer<u32> bufBitsC; // bigWord bits aligned for CarryA/M
+  Buffer<u32> bufBits;  // bigWord bits aligned for CarryFused/fftP
+  Buffer<u32> bufBitsC; // bigWord bits aligned for CarryA/M
 
   // "integer word" buffers. These are "small buffers": N x int.
   HostAccessBuffer<int> bufData;   // Main int buffer with the words.
   HostAccessBuffer<int> bufAux;    // Auxiliary int buffer, used in transposing data in/out and in check.
   Buffer<int> bufCheck;  // Buffers used with the error check.
+
+  // Copies of bufData and bufCheck taken after the last OK check, to roll back to after a failed one.
+  Buffer<int> bufSnapData;
+  Buffer<int> bufSnapCheck;
+
+  // The state at the pending speculative check, which becomes the snapshot if the check is OK.
+  // Allocated by the first speculative check of a test, released at the start of the next one.
+  std::optional<Buffer<int>> bufSpecData;
+  std::optional<Buffer<int>> bufSpecCheck;
+  vector<int> specResult; // read asynchronously from bufSmallOut
   
   // Carry buffers, used in carry and fusedCarry.
   Buffer<i64> bufCarry;  // Carry shuttle.
@@ -116,11 +150,16 @@ class Gpu {
   HostAccessBuffer<int> bufSmallOut;
   HostAccessBuffer<u64> bufSumOut;
 
+  // Used by the pack/unpack kernels. bufPacked holds the compact residue, (E-1)/32+1 words.
+  Buffer<i32> bufPackCodes;
+  Buffer<i32> bufPackBorrow;
+  HostAccessBuffer<u32> bufPacked;
+
   // Auxilliary big buffers
   Buffer<double> buf1;
   Buffer<double> buf2;
   Buffer<double> buf3;
-  
+
   vector<int> readSmall(Buffer<int>& buf, u32 start);
 
   void tW(Buffer<double>& out, Buffer<double>& in);
@@ -135,13 +174,22 @@ class Gpu {
   u32 modSqLoopMul3(Buffer<int>& out, Buffer<int>& in, u32 from, u32 to);
 
   bool equalNotZero(Buffer<int>& bufCheck, Buffer<int>& bufAux);
-  u64 bufResidue(Buffer<int>& buf);
+
+  // Enqueues the check without waiting for its result; speculativeCheckOK() tells it after the queue is finished.
+  void doCheckAsync(u32 blockSize, Buffer<double>& buf1, Buffer<double>& buf2, Buffer<double>& buf3);
+  bool speculativeCheckOK() const { return !specResult.empty() && specResult[0]; }
+  void commitSpeculation();
+
+  void takeSnapshot();
+  // Returns false if the restored data doesn't have the residue it had when taken.
+  bool restoreSnapshot(u64 res);
   
   vector<u32> writeBase(const vector<u32> &v);
 
   // Both "io" and "in" are in "low" position
   void multiplyLowLow(Buffer<double>& io, const Buffer<double>& in, Buffer<double>& tmp);
 
+  u32 makeOddPowers(vector<Buffer<double>>& bufPowers, u32 k);
   void exponentiateCore(Buffer<double>& out, const Buffer<double>& base, u64 exp, Buffer<double>& tmp);
   
   void exponentiate(Buffer<int>& bufInOut, u64 exp, Buffer<double>& buf1, Buffer<double>& buf2, Buffer<double>& buf3);
@@ -154,11 +202,25 @@ class Gpu {
   void tailMul(Buffer<double>& out, Buffer<double>& in, Buffer<double>& inTmp);
   
 
-  Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-      cl_device_id device, bool timeKernels, bool useLongCarry, struct Weights&& weights);
+  // What was precomputed for this task while the previous one was finishing, or null.
+  unique_ptr<Prepared> prepared;
+
+  void writeWeights(const Weights& weights);
+
+  // Reuse this Gpu, with its FFT, program and buffers, for a different exponent.
+  void setExponent(u32 newE, bool newUseLongCarry, Weights&& weights);
 
+  vector<bool> takePowerSmooth(u32 b1);
+  vector<bool> takePrimes(u32 b1, u32 b2);
+
+  // Reads and clears the roundoff stats accumulated by the kernels (with STATS).
+  RoundoffStats readRoundoff();
   void printRoundoff(u32 E);
 
+  void setKernelCosts(u32 W, u32 SMALL_H, u32 MIDDLE);
+  double measureCopyGBps();
+  const KernelCost* findCost(const string& name); // nullptr if not set
+
   // does either carrryFused() or the expanded version depending on useLongCarry
   void doCarry(Buffer<double>& out, Buffer<double>& in);
 
@@ -191,28 +253,43 @@ public:
 
   void finish() { queue->finish(); }
 
+  // Logs the host time spent enqueueing the squaring iterations, with and without KernelSequence.
+  void benchHost(u32 nIters);
+
+  // Times the main operations and their kernels, with nIters squarings (fewer of the costlier operations).
+  vector<BenchResult> bench(u32 nIters);
+
+  // The roundoff of nIters squarings from a full-size residue (with STATS).
+  RoundoffStats measureRoundoff(u32 nIters);
+
   // acc := acc * data; with "data" in lowish position.
   void accumulate(Buffer<int>& acc, Buffer<double>& data, Buffer<double>& tmp1, Buffer<double>& tmp2);
 
   
-  static unique_ptr<Gpu> make(u32 E, const Args &args);
+  // The returned Gpu is owned by the session, and may be reused by the next task.
+  // A variant overrides the FFT from the args and the tuning.
+  static Gpu* make(u32 E, GpuSession& session, const Variant* variant = nullptr);
   static void doDiv9(u32 E, Words& words);
   static bool equals9(const Words& words);
   
-  Gpu(const Args& args, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
-      cl_device_id device, bool timeKernels, bool useLongCarry);
+  Gpu(GpuSession& session, u32 E, u32 W, u32 BIG_H, u32 SMALL_H, u32 nW, u32 nH,
+      cl_program program, bool useLongCarry, Weights&& weights, Trig&& trig);
+  ~Gpu();
 
   vector<u32> readAndCompress(ConstBuffer<int>& buf);
+  vector<u32> readPacked(ConstBuffer<int>& buf);
   void writeIn(Buffer<int>& buf, const vector<u32> &words);
   void writeData(const vector<u32> &v) { writeIn(bufData, v); }
   void writeCheck(const vector<u32> &v) { writeIn(bufCheck, v); }
   
+  u64 bufResidue(Buffer<int>& buf);
   u64 dataResidue()  { return bufResidue(bufData); }
   u64 checkResidue() { return bufResidue(bufCheck); }
     
   bool doCheck(u32 blockSize, Buffer<double>&, Buffer<double>&, Buffer<double>&);
 
   void logTimeKernels();
+  string kernelSummary();
 
   vector<u32> readCheck();
   vector<u32> readData();
@@ -223,16 +300,54 @@ public:
   
   u32 getFFTSize() { return N; }
 
-  // return A^h * B
-  Words expMul(const Words& A, u64 h, const Words& B);
-
-  // return A^h * B^2
-  Words expMul2(const Words& A, u64 h, const Words& B);
-
   // A:= A^h * B
   void expMul(Buffer<i32>& A, u64 h, Buffer<i32>& B);
+
+  // A:= A^h * B^2
+  void expMul2(Buffer<i32>& A, u64 h, Buffer<i32>& B);
   
-  // return A^(2^n)
-  Words expExp2(const Words& A, u32 n);
+  // A:= A^(2^n)
+  void expExp2(Buffer<i32>& A, u32 n);
   vector<Buffer<i32>> makeBufVector(u32 size);
 };
+
+// The device state that outlives the individual tasks: context, queue, compiled programs,
+// and the most recent Gpu, which is reused by the next task if it has the same FFT and program.
+class GpuSession {
+  friend class Gpu;
+  
+  const Args& args;
+  cl_device_id device;
+  Context context;
+  QueuePtr queue;
+  std::map<string, Holder<cl_program>> programs; // keyed by the full build args
+  string gpuKey;
+  unique_ptr<Gpu> gpu;
+  unique_ptr<Prepared> prepared;
+  CheckPolicy checkPolicy;
+  CrossoverTable crossovers;
+  TuneTable tuning;
+
+  // The tuned variant for the exponent, if any and if the FFT is not set with -fft.
+  const Variant* tunedFor(u32 E) const;
+
+public:
+  explicit GpuSession(const Args& args);
+  ~GpuSession();
+
+  // Starts, in the background, the CPU-heavy setup of the task that follows "current" in worktodo:
+  // program compilation, weights, trig tables and the P-1 bit vectors. Gpu::make() picks them up.
+  void prepareNext(const Task& current);
+
+  // Measures the roundoff of the FFT configs matching "what" (a FFT spec or size, or "all") over a sweep of
+  // exponents around their crossover, and records the fitted max bits-per-word in the crossover table.
+  void calibrate(const string& what);
+
+  // Benchmarks each of the comma separated FFT specs or exponents, and writes the results to -benchOut if given.
+  void bench(const string& what);
+
+  // Benchmarks the variants of the FFT size for the exponent: first the width:middle:height configs, then the -use
+  // options one group at a time (greedily), each with a short timed squaring loop plus a roundoff check.
+  // The fastest is recorded in the tuning table.
+  void tune(u32 E);
+};
@@ -0,0 +1,93 @@
+// Copyright (C) Mihai Preda.
+
+#include "KernelCache.h"
+#include "File.h"
+#include "Sha3Hash.h"
+
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+
+std::atomic<u32> KernelCache::nHit = 0;
+std::atomic<u32> KernelCache::nMiss = 0;
+std::atomic<u32> KernelCache::nTmp = 0;
+
+// Returns the binary without the CRC trailer, or empty if the entry is missing or corrupted.
+string KernelCache::read(const fs::path& path) {
+  File f = File::openRead(path);
+  if (!f) { return {}; }
+  string bytes = f.readAll();
+  u32 crc = 0;
+  if (bytes.size() > sizeof(crc)) {
+    memcpy(&crc, bytes.data() + bytes.size() - sizeof(crc), sizeof(crc));
+    bytes.resize(bytes.size() - sizeof(crc));
+    if (crc == crc32(bytes.data(), bytes.size())) { return bytes; }
+  }
+  log("kernel cache: '%s' is corrupted\n", path.string().c_str());
+  remove(path);
+  return {};
+}
+
+bool KernelCache::write(const fs::path& path, const string& bytes) {
+  fs::path tmp = path;
+  tmp += "."s + to_string(getpid()) + "-" + to_string(nTmp++) + ".tmp";
+  try {
+    {
+      File f = File::openWrite(tmp);
+      f.write(bytes);
+      f.write<u32>({crc32(bytes.data(), bytes.size())});
+    }
+    fs::rename(tmp, path);
+    return true;
+  } catch (const fs::filesystem_error& e) {
+    log("kernel cache: can't write '%s' : %s\n", path.string().c_str(), e.what());
+  } catch (const std::ios_base::failure& e) {
+    log("kernel cache: can't write '%s' : %s\n", path.string().c_str(), e.what());
+  }
+  remove(tmp);
+  return false;
+}
+
+void KernelCache::remove(const fs::path& path) {
+  std::error_code noThrow;
+  fs::remove(path, noThrow);
+}
+
+cl_program KernelCache::compile(cl_context context, cl_device_id id, const string& source, const string& extraArgs,
+                                const vector<string>& defines) {
+  auto hash = SHA3::hash(source, buildArgs(extraArgs, defines), getLongInfo(id), getDriverVersion(id));
+  fs::path path = dir / (hex(hash[0]) + hex(hash[1]) + ".bin");
+
+  if (string bytes = read(path); !bytes.empty()) {
+    try {
+      cl_program program = fromBinary(context, id, bytes);
+      u32 hits = ++nHit;
+      log("kernel cache: loaded '%s' (%u hits, %u misses)\n", path.filename().string().c_str(), hits, u32(nMiss));
+      return program;
+    } catch (const std::exception& e) {
+      log("kernel cache: can't load '%s' : %s\n", path.string().c_str(), e.what());
+      remove(path);
+    }
+  }
+
+  u32 misses = ++nMiss;
+  cl_program program = ::compile(context, id, source, extraArgs, defines);
+  if (program && write(path, getBinary(program))) {
+    log("kernel cache: stored '%s' (%u hits, %u misses)\n", path.filename().string().c_str(), u32(nHit), misses);
+  }
+  return program;
+}
+
+void KernelCache::trim(const string& prefix, u32 keep) {
+  vector<pair<fs::file_time_type, fs::path>> entries;
+  std::error_code noThrow;
+  for (const auto& entry : fs::directory_iterator(dir, noThrow)) {
+    string name = entry.path().filename().string();
+    if (name.compare(0, prefix.size(), prefix) == 0 && entry.path().extension() == ".bin") {
+      entries.push_back({entry.last_write_time(noThrow), entry.path()});
+    }
+  }
+  if (entries.size() <= keep) { return; }
+  std::sort(entries.begin(), entries.end(), std::greater{});
+  for (auto it = entries.begin() + keep; it != entries.end(); ++it) { remove(it->second); }
+}
@@ -0,0 +1,43 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "clwrap.h"
+
+#include <atomic>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Persistent cache of compiled program binaries.
+// An entry is keyed by a hash of everything that goes into the compilation: source, defines, compiler args,
+// device and driver version. Thus a stale entry is never matched, it simply becomes unused.
+// Entries are written to a temporary file then renamed, so instances sharing the cache dir (e.g. in a -pool)
+// never see a partial entry.
+// The same dir also holds other precomputed data (the trig and weights tables) as named entries.
+class KernelCache {
+  fs::path dir;
+
+  // Programs may be compiled from background threads.
+  static std::atomic<u32> nHit;
+  static std::atomic<u32> nMiss;
+  static std::atomic<u32> nTmp; // makes the temporary file names unique within the process
+
+  string read(const fs::path& path);
+  // Returns false (after logging why) if the entry could not be written.
+  bool write(const fs::path& path, const string& bytes);
+  void remove(const fs::path& path);
+
+public:
+  explicit KernelCache(const fs::path& dir) : dir{dir} {}
+
+  cl_program compile(cl_context context, cl_device_id id, const string& source, const string& extraArgs,
+                     const std::vector<string>& defines);
+
+  // Named entries, CRC-checked like the binaries. load() returns empty if missing or corrupted.
+  string load(const string& name) { return read(dir / name); }
+  void store(const string& name, const string& bytes) { write(dir / name, bytes); }
+
+  // Removes the least recently written entries starting with "prefix", keeping the newest "keep".
+  void trim(const string& prefix, u32 keep);
+};
@@ -12,6 +12,7 @@
 #include <filesystem>
 #include <cinttypes>
 #include <climits>
+#include <future>
 
 #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
 #error Byte order must be Little Endian
@@ -93,8 +94,13 @@ bool Proof::verify(Gpu *gpu) const {
 
   bool isPrime = (B == makeWords(E, 9));
 
-  Words A{makeWords(E, 3)};
-  Words B{this->B};
+  // A, B and the middle stay on the GPU; the hashes depend only on B and the middles, which are on the host already.
+  vector<Buffer<i32>> bufs = gpu->makeBufVector(3);
+  Buffer<i32>* bufA = &bufs[0];
+  Buffer<i32>* bufB = &bufs[1];
+  Buffer<i32>* bufM = &bufs[2];
+  gpu->writeIn(*bufA, makeWords(E, 3));
+  gpu->writeIn(*bufB, B);
   
   auto hash = proof::hashWords(E, B);
 
@@ -102,26 +108,32 @@ bool Proof::verify(Gpu *gpu) const {
   for (u32 i = 0; i < power; ++i, span = (span + 1) / 2) {
     const Words& M = middles[i];
     hash = proof::hashWords(E, hash, M);
-    u64 h = hash[0];    
-    A = gpu->expMul(A, h, M);
-    
+    u64 h = hash[0];
+    gpu->writeIn(*bufM, M);
+    gpu->expMul(*bufA, h, *bufM);
+
+    // B := M^h * B, or M^h * B^2; computed in place of M, which is not needed anymore.
     if (span % 2) {
-      B = gpu->expMul2(M, h, B);
+      gpu->expMul2(*bufM, h, *bufB);
     } else {
-      B = gpu->expMul(M, h, B);
+      gpu->expMul(*bufM, h, *bufB);
     }
+    std::swap(bufB, bufM);
 
-    log("%u : A %016" PRIx64 ", M %016" PRIx64 ", B %016" PRIx64 ", h %016" PRIx64 "\n", i, res64(A), res64(M), res64(B), h); 
+    log("%u : A %016" PRIx64 ", M %016" PRIx64 ", B %016" PRIx64 ", h %016" PRIx64 "\n",
+        i, gpu->bufResidue(*bufA), res64(M), gpu->bufResidue(*bufB), h);
   }
     
   log("proof verification: doing %d iterations\n", span);
-  A = gpu->expExp2(A, span);
+  gpu->expExp2(*bufA, span);
 
-  bool ok = (A == B);
+  Words A = gpu->readAndCompress(*bufA);
+  Words finalB = gpu->readAndCompress(*bufB);
+  bool ok = (A == finalB);
   if (ok) {
     log("proof: %u proved %s\n", E, isPrime ? "probable prime" : "composite");
   } else {
-    log("proof: invalid (%016" PRIx64 " expected %016" PRIx64 ")\n", res64(A), res64(B));
+    log("proof: invalid (%016" PRIx64 " expected %016" PRIx64 ")\n", res64(A), res64(finalB));
   }
   return ok;
 }
@@ -135,26 +147,6 @@ ProofSet::ProofSet(const fs::path& tmpDir, u32 E, u32 power)
   assert(power > 0);
     
   fs::create_directory(exponentDir);
-  fs::create_directory(proofPath);
-
-  vector<u32> spans;
-  for (u32 span = (E + 1) / 2; spans.size() < power; span = (span + 1) / 2) { spans.push_back(span); }
-
-  points.push_back(0);
-  for (u32 p = 0, span = (E + 1) / 2; p < power; ++p, span = (span + 1) / 2) {
-    for (u32 i = 0, end = points.size(); i < end; ++i) {
-      points.push_back(points[i] + span);
-    }
-  }
-
-  assert(points.size() == (1u << power));
-    
-  std::sort(points.begin(), points.end());
-
-  points.erase(points.begin());
-  assert(points.back() < E);
-  points.push_back(E);
-  assert(points.size() == (1u << power));
 }
 
 bool ProofSet::canDo(const fs::path& tmpDir, u32 E, u32 power, u32 currentK) {
@@ -164,20 +156,31 @@ bool ProofSet::canDo(const fs::path& tmpDir, u32 E, u32 power, u32 currentK) {
 
 u32 ProofSet::effectivePower(const fs::path& tmpDir, u32 E, u32 power, u32 currentK) {
   for (u32 p = power; p > 0; --p) {
-    log("validating proof residues for power %u\n", p);
     if (canDo(tmpDir, E, p, currentK)) { return p; }      
   }
   assert(false);
 }
     
+// Decided from the manifest alone; the residues' contents are checked later by verifyTo().
 bool ProofSet::isValidTo(u32 limitK) const {
   for (u32 k : points) {
-    if (k > limitK) { break; }
-    try { load(k); } catch (...) { return false; }
+    if (!cache.hasSlot(k) || (k <= limitK && !cache.isValid(k))) { return false; }
   }
   return true;
 }
 
+bool ProofSet::verifyTo(u32 limitK) {
+  bool ok = true;
+  for (u32 k : points) {
+    if (k > limitK) { break; }
+    if (!cache.verify(k)) {
+      log("proof residue %u is corrupted\n", k);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 u32 ProofSet::next(u32 k) const {
   auto it = upper_bound(points.begin(), points.end(), k);
   return (it == points.end()) ? u32(-1) : *it;
@@ -206,12 +209,25 @@ Proof ProofSet::computeProof(Gpu *gpu) const {
 
   vector<Buffer<i32>> bufVect = gpu->makeBufVector(power);
 
+  // The hashes depend on B, so no level can be built before the end of the test; but the order in which
+  // the residues are needed is known, so the next one is read from disk while the GPU works on the current one.
+  vector<u32> order;
+  for (u32 p = 0; p < power; ++p) {
+    u32 s = (1u << (power - p - 1));
+    for (u32 i = 0; i < (1u << p); ++i) { order.push_back(points[s * (i * 2 + 1) - 1]); }
+  }
+  auto prefetch = [this, &order](u32 pos) {
+    return pos < order.size() ? std::async(std::launch::async, [this, k = order[pos]]() { return load(k); }) : std::future<Words>{};
+  };
+  u32 nextPos = 0;
+  std::future<Words> nextWords = prefetch(nextPos);
+
   for (u32 p = 0; p < power; ++p) {
     auto bufIt = bufVect.begin();
     assert(p == hashes.size());
-    u32 s = (1u << (power - p - 1));
     for (u32 i = 0; i < (1u << p); ++i) {
-      Words w = load(points[s * (i * 2 + 1) - 1]);
+      Words w = nextWords.get();
+      nextWords = prefetch(++nextPos);
       gpu->writeIn(*bufIt++, w);
       for (u32 k = 0; i & (1u << k); ++k) {
         assert(k <= p - 1);
@@ -59,10 +59,9 @@ public:
   
 private:  
   fs::path exponentDir;
-  fs::path proofPath{exponentDir / "proof"};
-  ProofCache cache{E, proofPath};
+  ProofCache cache{E, power, exponentDir / "proof.slots", exponentDir / "proof"};
 
-  vector<u32> points;  
+  vector<u32> points{proofPoints(E, power)};
   
   bool isValidTo(u32 limitK) const;
 
@@ -76,9 +75,16 @@ public:
     
   u32 next(u32 k) const;
 
+  // Queues the residue to be written in the background.
   void save(u32 k, const Words& words);
 
   Words load(u32 k) const;
+
+  // Reads back all the residues up to limitK; the corrupted ones are dropped from the manifest.
+  bool verifyTo(u32 limitK);
+
+  // The residues whose (background) write failed since the previous call; they are kept in memory.
+  vector<u32> takeWriteFailures() { return cache.takeFailures(); }
         
   Proof computeProof(Gpu *gpu) const;
 };
@@ -2,36 +2,367 @@
 
 #include "ProofCache.h"
 #include "File.h"
+#include "Trace.h"
 
-bool ProofCache::write(u32 k, const Words& words) {
-  try {
-    File f = File::openWrite(proofPath / to_string(k));
-    f.write(words);
-    f.write<u32>({crc32(words)});
-  } catch (fs::filesystem_error& e) {
-    return false;
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+#if defined(_WIN32) || defined(__WIN32__)
+// No pread/pwrite on Windows: emulate them with a lock around seek + read/write.
+std::mutex ioMutex;
+
+ssize_t pread(int fd, void* buf, size_t size, u64 offset) {
+  std::unique_lock lock{ioMutex};
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) { return -1; }
+  return _read(fd, buf, size);
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t size, u64 offset) {
+  std::unique_lock lock{ioMutex};
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) { return -1; }
+  return _write(fd, buf, size);
+}
+
+void datasync(int fd) { _commit(fd); }
+#else
+void datasync(int fd) { fdatasync(fd); }
+#endif
+
+bool readAt(int fd, void* data, size_t size, u64 offset) {
+  char* p = static_cast<char*>(data);
+  while (size) {
+    ssize_t n = pread(fd, p, size, offset);
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+    offset += n;
   }
+  return true;
+}
 
-  assert(words == read(k));
+bool writeAt(int fd, const void* data, size_t size, u64 offset) {
+  const char* p = static_cast<const char*>(data);
+  while (size) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+    offset += n;
+  }
   return true;
 }
 
-Words ProofCache::read(u32 k) const {
-  File f = File::openReadThrow(proofPath / to_string(k));
-  vector<u32> words = f.read<u32>(E / 32 + 2);
-  u32 checksum = words.back();
-  words.pop_back();
-  if (checksum != crc32(words)) {
-    log("checksum %x (expected %x) in '%s'\n", crc32(words), checksum, f.name.c_str());
-    throw fs::filesystem_error{"checksum mismatch", {}};
+// Manifest layout: magic, CRC of what follows, E, power, slotWords, seq; then a CRC per slot and the valid bitmap.
+constexpr const u32 FIXED_HEADER = 28;
+
+u32 manifestBytes(u32 nSlots) { return FIXED_HEADER + nSlots * sizeof(u32) + (nSlots + 7) / 8; }
+
+}
+
+vector<u32> proofPoints(u32 E, u32 power) {
+  vector<u32> points;
+  points.push_back(0);
+  for (u32 p = 0, span = (E + 1) / 2; p < power; ++p, span = (span + 1) / 2) {
+    for (u32 i = 0, end = points.size(); i < end; ++i) {
+      points.push_back(points[i] + span);
+    }
   }
-  return words;
+
+  assert(points.size() == (1u << power));
+
+  std::sort(points.begin(), points.end());
+
+  points.erase(points.begin());
+  assert(points.back() < E);
+  points.push_back(E);
+  assert(points.size() == (1u << power));
+  return points;
 }
 
+ProofCache::ProofCache(u32 E, u32 power, const fs::path& path, const fs::path& legacyDir)
+  : E{E}, path{path}, slotWords{E / 32 + 1}, power{power} {
+  if (fs::exists(path)) {
+    bool ok = readHeader();
+    if (ok && this->power != power && std::none_of(valid.begin(), valid.end(), [](bool b) { return b; })) {
+      // Empty container of a different power: start over with the requested one.
+      ok = false;
+    }
+
+    if (!ok) {
+      if (fd >= 0) { close(fd); }
+      fd = -1;
+      this->power = power;
+      fs::remove(path);
+    }
+  }
+
+  if (fd < 0) {
+    points = proofPoints(E, this->power);
+    crcs.assign(points.size(), 0);
+    valid.assign(points.size(), false);
+  }
+
+  if (fs::is_directory(legacyDir)) { importLegacy(legacyDir); }
+}
+
+ProofCache::~ProofCache() {
+  {
+    std::unique_lock lock{mut};
+    stop = true;
+  }
+  cv.notify_all();
+  if (writer.joinable()) { writer.join(); }
 
-void ProofCache::flush() {
-  for (auto it = pending.cbegin(), end = pending.cend(); it != end && write(it->first, it->second); it = pending.erase(it));
   if (!pending.empty()) {
-    log("Could not write %u residues under '%s' -- hurry make space!\n", u32(pending.size()), proofPath.string().c_str());
+    log("Could not write %u residues to '%s' -- hurry make space!\n", u32(pending.size()), path.string().c_str());
+  }
+  if (fd >= 0) { close(fd); }
+}
+
+u32 ProofCache::slotOf(u32 k) const {
+  auto it = lower_bound(points.begin(), points.end(), k);
+  return (it != points.end() && *it == k) ? u32(it - points.begin()) : u32(-1);
+}
+
+// Picks the valid copy of the manifest with the highest sequence number.
+bool ProofCache::readHeader() {
+  fd = open(path.string().c_str(), O_RDWR);
+  if (fd < 0) { return false; }
+
+  vector<char> copies[2];
+  for (u32 i = 0; i < 2; ++i) {
+    copies[i].resize(HEADER_BYTES);
+    if (!readAt(fd, copies[i].data(), HEADER_BYTES, i * HEADER_BYTES)) { copies[i].clear(); }
+  }
+
+  u32 seqs[2] = {0, 0};
+  for (u32 i = 0; i < 2; ++i) {
+    if (!copies[i].empty()) { memcpy(&seqs[i], copies[i].data() + 24, sizeof(u32)); }
   }
+  u32 first = seqs[1] > seqs[0];
+  if (parseHeader(copies[first]) || parseHeader(copies[1 - first])) { return true; }
+
+  log("'%s' has no valid manifest\n", path.string().c_str());
+  return false;
+}
+
+bool ProofCache::parseHeader(const vector<char>& buf) {
+  if (buf.size() < FIXED_HEADER || memcmp(buf.data(), MAGIC, sizeof(MAGIC))) { return false; }
+
+  u32 fixed[5];
+  memcpy(fixed, buf.data() + 8, sizeof(fixed));
+  auto [crc, fileE, filePower, fileSlotWords, fileSeq] = fixed;
+  if (fileE != E || fileSlotWords != slotWords || filePower == 0 || filePower > 12) { return false; }
+
+  u32 n = 1u << filePower;
+  if (crc32(buf.data() + 12, manifestBytes(n) - 12) != crc) { return false; }
+
+  power = filePower;
+  seq = fileSeq;
+  points = proofPoints(E, power);
+  crcs.resize(n);
+  memcpy(crcs.data(), buf.data() + FIXED_HEADER, n * sizeof(u32));
+  valid.resize(n);
+  const char* bitmap = buf.data() + FIXED_HEADER + n * sizeof(u32);
+  for (u32 i = 0; i < n; ++i) { valid[i] = bitmap[i / 8] & (1 << (i % 8)); }
+  return true;
+}
+
+// Must be called with the lock held. Overwrites the older copy of the manifest.
+void ProofCache::writeHeader() {
+  u32 n = points.size();
+  vector<char> buf(manifestBytes(n));
+  ++seq;
+  u32 fixed[5] = {0, E, power, slotWords, seq};
+  memcpy(buf.data(), MAGIC, sizeof(MAGIC));
+  memcpy(buf.data() + 8, fixed, sizeof(fixed));
+  memcpy(buf.data() + FIXED_HEADER, crcs.data(), n * sizeof(u32));
+  char* bitmap = buf.data() + FIXED_HEADER + n * sizeof(u32);
+  for (u32 i = 0; i < n; ++i) { if (valid[i]) { bitmap[i / 8] |= (1 << (i % 8)); } }
+  u32 crc = crc32(buf.data() + 12, buf.size() - 12);
+  memcpy(buf.data() + 8, &crc, sizeof(crc));
+
+  if (!writeAt(fd, buf.data(), buf.size(), (seq % 2) * HEADER_BYTES)) {
+    throw fs::filesystem_error("can't write proof container manifest", path, {});
+  }
+  datasync(fd);
+}
+
+// Must be called with the lock held.
+void ProofCache::create() {
+  fd = open(path.string().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) { throw fs::filesystem_error("can't create proof container", path, {}); }
+
+  u64 size = slotOffset(points.size());
+#if !defined(_WIN32) && !defined(__WIN32__)
+  // Allocate all the slots up front, sequentially. Not fatal if it fails: the slots are then allocated on write.
+  if (int err = posix_fallocate(fd, 0, size)) {
+    log("can't preallocate %.1f GB for '%s' (error %d)\n", size * (1.0 / (1 << 30)), path.string().c_str(), err);
+  }
+#endif
+  log("created proof container '%s' for power %u\n", path.string().c_str(), power);
+  writeHeader();
+}
+
+// Moves the residues from the older one-file-per-iteration layout into the container.
+void ProofCache::importLegacy(const fs::path& dir) {
+  u32 nImported = 0;
+  for (u32 k : points) {
+    File f = File::openRead(dir / to_string(k));
+    if (!f) { continue; }
+    try {
+      vector<u32> words = f.read<u32>(slotWords + 1);
+      u32 checksum = words.back();
+      words.pop_back();
+      if (checksum == crc32(words) && write(k, words)) { ++nImported; }
+    } catch (const std::ios_base::failure&) {
+    }
+  }
+  log("imported %u proof residues from '%s'\n", nImported, dir.string().c_str());
+  fs::remove_all(dir);
+}
+
+void ProofCache::save(u32 k, const Words& words) {
+  std::unique_lock lock{mut};
+  if (!writer.joinable()) { writer = std::thread{&ProofCache::run, this}; }
+  cv.wait(lock, [this]() { return queue.size() < MAX_QUEUED; });
+  queue.push_back({k, words});
+  cv.notify_all();
+}
+
+bool ProofCache::isValid(u32 k) const {
+  u32 slot = slotOf(k);
+  std::unique_lock lock{mut};
+  return slot != u32(-1) && valid[slot];
+}
+
+bool ProofCache::verify(u32 k) {
+  {
+    std::unique_lock lock{mut};
+    // Being (re)written, and verified by the write.
+    for (const auto& [queuedK, words] : queue) { if (queuedK == k) { return true; } }
+    if (pending.count(k)) { return true; }
+  }
+
+  try {
+    read(k);
+    return true;
+  } catch (const fs::filesystem_error&) {
+  }
+
+  std::unique_lock lock{mut};
+  if (u32 slot = slotOf(k); slot != u32(-1) && valid[slot]) {
+    valid[slot] = false;
+    try {
+      writeHeader();
+    } catch (const fs::filesystem_error&) {
+    }
+  }
+  return false;
+}
+
+Words ProofCache::load(u32 k) const {
+  {
+    std::unique_lock lock{mut};
+    for (const auto& [queuedK, words] : queue) { if (queuedK == k) { return words; } }
+    if (auto it = pending.find(k); it != pending.end()) { return it->second; }
+  }
+  return read(k);
+}
+
+void ProofCache::flush() {
+  std::unique_lock lock{mut};
+  cv.wait(lock, [this]() { return queue.empty(); });
+}
+
+vector<u32> ProofCache::takeFailures() {
+  std::unique_lock lock{mut};
+  return std::move(failures);
+}
+
+void ProofCache::clear() {
+  flush();
+  std::unique_lock lock{mut};
+  pending.clear();
+}
+
+void ProofCache::run() {
+  std::unique_lock lock{mut};
+  while (true) {
+    cv.wait(lock, [this]() { return stop || !queue.empty(); });
+    if (queue.empty()) { return; }
+
+    // The entry stays in the queue while being written, so that load() finds it.
+    auto& [k, words] = queue.front();
+    lock.unlock();
+    bool ok = write(k, words);
+    lock.lock();
+
+    if (ok) {
+      // There's space again: retry the ones that failed before.
+      for (auto& [pendingK, pendingWords] : pending) { queue.push_back({pendingK, std::move(pendingWords)}); }
+      pending.clear();
+    } else {
+      failures.push_back(k);
+      pending[k] = std::move(words);
+    }
+    queue.pop_front();
+    cv.notify_all();
+  }
+}
+
+bool ProofCache::write(u32 k, const Words& words) {
+  Span span{"proof write", "async"};
+  u32 slot = slotOf(k);
+  assert(slot != u32(-1) && words.size() == slotWords);
+
+  try {
+    int fileFd = -1;
+    {
+      std::unique_lock lock{mut};
+      if (fd < 0) { create(); }
+      fileFd = fd;
+    }
+
+    u64 offset = slotOffset(slot);
+    if (!writeAt(fileFd, words.data(), slotWords * sizeof(u32), offset)) { return false; }
+    datasync(fileFd);
+
+    Words back(slotWords);
+    if (!readAt(fileFd, back.data(), slotWords * sizeof(u32), offset) || back != words) { return false; }
+
+    std::unique_lock lock{mut};
+    crcs[slot] = crc32(words);
+    valid[slot] = true;
+    writeHeader();
+    return true;
+  } catch (const fs::filesystem_error&) {
+    return false;
+  }
+}
+
+Words ProofCache::read(u32 k) const {
+  u32 slot = slotOf(k);
+  int fileFd = -1;
+  u32 crc = 0;
+  {
+    std::unique_lock lock{mut};
+    if (slot == u32(-1) || !valid[slot]) { throw fs::filesystem_error{"missing proof residue " + to_string(k), path, {}}; }
+    fileFd = fd;
+    crc = crcs[slot];
+  }
+
+  Words words(slotWords);
+  if (!readAt(fileFd, words.data(), slotWords * sizeof(u32), slotOffset(slot))) {
+    throw fs::filesystem_error{"can't read proof residue " + to_string(k), path, {}};
+  }
+  if (crc32(words) != crc) {
+    log("checksum %x (expected %x) for %u in '%s'\n", crc32(words), crc, k, path.string().c_str());
+    throw fs::filesystem_error{"checksum mismatch", path, {}};
+  }
+  return words;
 }
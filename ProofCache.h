@@ -6,35 +6,91 @@
 
 #include <unordered_map>
 #include <filesystem>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace fs = std::filesystem;
 
+// The iterations at which the residues are saved for a proof of the given power, ending with E.
+vector<u32> proofPoints(u32 E, u32 power);
+
+// Write-behind cache of the proof residues. save() queues the residue for a background thread which writes,
+// syncs and re-reads it; save() only blocks when MAX_QUEUED residues are already waiting.
+// The residues that could not be written are kept in memory and retried after the next successful write.
+//
+// The residues are stored in a single container file with one fixed-size slot per proof point. The file starts
+// with a manifest holding E, the power, a CRC per slot and a bitmap of the valid slots. The manifest is kept in
+// two copies written alternately, each with a sequence number and its own CRC, so that an interrupted update
+// leaves the previous one intact. The container may be of a larger power than the ProofSet using it, as the
+// points of a lower power are a subset.
 class ProofCache {
+  static constexpr const u32 MAX_QUEUED = 4;
+  static constexpr const char MAGIC[8] = {'P', 'R', 'P', 'S', 'L', 'O', 'T', '2'};
+  // Enough for a manifest of power 12.
+  static constexpr const u32 HEADER_BYTES = 5 * 4096;
+
   const u32 E;
+  const fs::path path;
+  const u32 slotWords;
+
+  // Read from the file's header, or the requested power if the file is not there (yet).
+  u32 power;
+  vector<u32> points;
+  vector<u32> crcs;
+  vector<bool> valid;
+  u32 seq = 0;
+  int fd = -1;
+
+  mutable std::mutex mut;
+  std::condition_variable cv;
+  std::deque<pair<u32, Words>> queue; // the front one is being written
   std::unordered_map<u32, Words> pending;
-  fs::path proofPath;
-  
+  vector<u32> failures;
+  bool stop = false;
+  std::thread writer;
+
+  u64 slotOffset(u32 slot) const { return 2 * HEADER_BYTES + u64(slot) * slotWords * sizeof(u32); }
+
+  // Returns the slot for iteration k, or -1 if none.
+  u32 slotOf(u32 k) const;
+
+  bool readHeader();
+  bool parseHeader(const vector<char>& buf);
+  void writeHeader();
+  void create();
+  void importLegacy(const fs::path& dir);
+
   bool write(u32 k, const Words& words);
 
   Words read(u32 k) const;
 
-  void flush();
-  
+  void run();
+
 public:
-  ProofCache(u32 E, const fs::path& proofPath) : E{E}, proofPath{proofPath} {}
-  
-  ~ProofCache() { flush(); }
-  
-  void save(u32 k, const Words& words) {
-    if (pending.empty() && write(k, words)) { return; }    
-    pending[k] = words;
-    flush();
-  }
-
-  Words load(u32 k) const {
-    auto it = pending.find(k);
-    return (it == pending.end()) ? read(k) : it->second;
-  }
-
-  void clear() { pending.clear(); }
+  ProofCache(u32 E, u32 power, const fs::path& path, const fs::path& legacyDir);
+
+  ~ProofCache();
+
+  // Whether there is a slot for iteration k.
+  bool hasSlot(u32 k) const { return slotOf(k) != u32(-1); }
+
+  // Whether the manifest records a residue for iteration k, without reading it.
+  bool isValid(u32 k) const;
+
+  // Reads back the residue at k and checks its CRC; a bad residue is marked invalid in the manifest.
+  bool verify(u32 k);
+
+  void save(u32 k, const Words& words);
+
+  Words load(u32 k) const;
+
+  // Waits until the queue is written.
+  void flush();
+
+  // The residues that failed to be written since the previous call.
+  vector<u32> takeFailures();
+
+  void clear();
 };
@@ -3,10 +3,13 @@
 #pragma once
 
 #include "Buffer.h"
+#include "Trace.h"
 
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 #include <unistd.h>
@@ -16,51 +19,112 @@ template<typename T> class Buffer;
 
 struct TimeInfo {
   double total{};
+  double totalSq{};
   u32 n{};
 
   bool operator<(const TimeInfo& rhs) const { return total > rhs.total; }
-  void add(float deltaTime, u32 deltaN = 1) { total += deltaTime; n += deltaN; }
-  void clear() { total = 0; n = 0; }
+  void add(float deltaTime, u32 deltaN = 1) { total += deltaTime; totalSq += double(deltaTime) * deltaTime / deltaN; n += deltaN; }
+  void clear() { total = 0; totalSq = 0; n = 0; }
+
+  double mean() const { return n ? total / n : 0; }
+
+  // Half-width of the 95% confidence interval of the mean.
+  double ci95() const {
+    if (n < 2) { return 0; }
+    double var = std::max(0.0, (totalSq - total * total / n) / (n - 1));
+    return 1.96 * std::sqrt(var / n);
+  }
 };
 
 class Event : public EventHolder {
 public:
   double secs() { return getEventNanos(this->get()) * 1e-9f; }
+  std::pair<u64, u64> startEnd() { return getEventStartEnd(this->get()); }
   bool isComplete() { return getEventInfo(this->get()) == CL_COMPLETE; }
 };
 
 using QueuePtr = std::shared_ptr<class Queue>;
 
 class Queue : public QueueHolder {
+  // With sampling, the launches are profiled in windows of this many consecutive launches, so that
+  // a window covers all the kernels of an iteration or two.
+  static constexpr const u32 SAMPLE_WINDOW = 16;
+
   using TimeMap = std::map<std::string, TimeInfo>;
   TimeMap timeMap;
-  std::vector<std::pair<Event, TimeMap::iterator>> events;
+  struct Launch {
+    Event event;
+    TimeMap::iterator it; // timeMap.end() if not sampled
+    std::string name;     // set only when tracing
+  };
+  std::vector<Launch> events; // the profiled launches
+  Event lastEvent; // the last launch not profiled, for cudaYield
   bool profile{};
+  u32 sampleEvery{}; // profile one window out of every sampleEvery; 0 for all the launches
+  u32 windowLeft{};  // launches left in the current sample window
+  u32 gapLeft{};     // launches left to skip before the next window
+  std::minstd_rand rng;
   bool cudaYield{};
+  bool tracing{}; // the queue has profiling enabled so that all the launches can be traced
+
+  // Device timestamps are mapped to host time by taking the end of the last launch as "now" at finish().
+  void traceEvents() {
+    u64 hostNow = trace::now();
+    u64 lastEnd = 0;
+    for (auto& launch : events) { lastEnd = std::max(lastEnd, launch.event.startEnd().second); }
+    for (auto& launch : events) {
+      if (launch.name.empty()) { continue; }
+      auto [start, end] = launch.event.startEnd();
+      trace::gpu(launch.name, hostNow - (lastEnd - start) / 1000, hostNow - (lastEnd - end) / 1000);
+    }
+  }
 
 public:
-  Queue(cl_queue q, bool profile, bool cudaYield) : QueueHolder{q}, profile{profile}, cudaYield{cudaYield} {}  
-  static QueuePtr make(const Context& context, bool profile, bool cudaYield) { return make_shared<Queue>(makeQueue(context.deviceId(), context.get(), profile), profile, cudaYield); }
+  Queue(cl_queue q, bool profile, u32 sampleEvery, bool cudaYield, bool tracing)
+    : QueueHolder{q}, profile{profile || sampleEvery}, sampleEvery{profile ? 0 : sampleEvery}, cudaYield{cudaYield}, tracing{tracing} {}
+
+  static QueuePtr make(const Context& context, bool profile, u32 sampleEvery, bool cudaYield, bool tracing) {
+    return make_shared<Queue>(makeQueue(context.deviceId(), context.get(), profile || sampleEvery || tracing),
+                              profile, sampleEvery, cudaYield, tracing);
+  }
   
+  // The gaps between the windows are random, averaging (sampleEvery - 1) windows, so that the windows don't keep
+  // falling on the same kernels of the iteration.
+  bool sampleNext() {
+    if (windowLeft) {
+      --windowLeft;
+      return true;
+    }
+    if (gapLeft) {
+      --gapLeft;
+      return false;
+    }
+    windowLeft = SAMPLE_WINDOW - 1;
+    gapLeft = std::uniform_int_distribution<u32>{0, 2 * SAMPLE_WINDOW * (sampleEvery - 1)}(rng);
+    return true;
+  }
+
   void run(cl_kernel kernel, size_t groupSize, size_t workSize, const string &name) {
-    Event event{::run(get(), kernel, groupSize, workSize, name, profile || cudaYield)};
-    auto it = profile ? timeMap.insert({name, TimeInfo{}}).first : timeMap.end();
-    if (profile) {
-      events.emplace_back(std::move(event), it);
+    bool sampled = profile && (!sampleEvery || sampleNext());
+    bool traced = tracing && trace::enabled();
+    Event event{::run(get(), kernel, groupSize, workSize, name, sampled || traced || cudaYield)};
+    if (sampled || traced) {
+      events.push_back({std::move(event), sampled ? timeMap.insert({name, TimeInfo{}}).first : timeMap.end(), traced ? name : ""});
     } else if (cudaYield) {
-      if (events.empty()) {
-        events.emplace_back(std::move(event), it);
-      } else {
-        events.front() = std::make_pair(std::move(event), it);
-      }
+      lastEvent = std::move(event);
     }
   }
 
-  bool allEventsCompleted() { return events.empty() || events.back().first.isComplete(); }
+  bool isSampling() const { return sampleEvery != 0; }
+
+  bool allEventsCompleted() {
+    return (events.empty() || events.back().event.isComplete()) && (!lastEvent || lastEvent.isComplete());
+  }
 
   void flush() { ::flush(get()); }
   
   void finish() {
+    u64 begin = trace::enabled() ? trace::now() : 0;
     if (cudaYield) {
       flush();
       while (!allEventsCompleted()) {
@@ -73,9 +137,14 @@ public:
     }
     
     ::finish(get());
+    if (begin) { trace::complete("finish", "wait", begin, trace::now()); }
     
-    if (profile) { for (auto& [event, it] : events) { it->second.add(event.secs()); } }
+    if (tracing) { traceEvents(); }
+    for (auto& launch : events) {
+      if (launch.it != timeMap.end()) { launch.it->second.add(launch.event.secs()); }
+    }
     events.clear();
+    lastEvent.reset();
   }
 
   using Profile = std::vector<std::pair<TimeInfo, std::string>>;
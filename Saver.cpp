@@ -4,12 +4,15 @@
 #include "File.h"
 #include "Blake2.h"
 #include "Args.h"
+#include "Trace.h"
 
 #include <filesystem>
 #include <functional>
 #include <ios>
 #include <cassert>
 #include <cinttypes>
+#include <algorithm>
+#include <utility>
 
 
 namespace fs = std::filesystem;
@@ -86,7 +89,57 @@ Saver::Saver(u32 E, u32 nKeep, u32 b1, u32 startFrom) : E{E}, nKeep{max(nKeep, 5
   scan(startFrom);
 }
 
+Saver::~Saver() {
+  {
+    std::unique_lock lock{mut};
+    stop = true;
+  }
+  cv.notify_all();
+  if (writer.joinable()) { writer.join(); }
+  if (error) { log("A savefile could not be written\n"); }
+}
+
+void Saver::submit(u32 k, std::function<void()>&& job) {
+  std::unique_lock lock{mut};
+  if (!writer.joinable()) { writer = std::thread{&Saver::run, this}; }
+  cv.wait(lock, [this, k]() {
+    return std::all_of(queue.begin(), queue.end(), [k](const auto& entry) { return entry.first >= k; });
+  });
+  if (error) { std::rethrow_exception(std::exchange(error, nullptr)); }
+  queue.push_back({k, std::move(job)});
+  cv.notify_all();
+}
+
+void Saver::wait() {
+  std::unique_lock lock{mut};
+  cv.wait(lock, [this]() { return queue.empty(); });
+  if (error) { std::rethrow_exception(std::exchange(error, nullptr)); }
+}
+
+void Saver::run() {
+  std::unique_lock lock{mut};
+  while (true) {
+    cv.wait(lock, [this]() { return stop || !queue.empty(); });
+    if (queue.empty()) { return; }
+
+    auto& job = queue.front().second;
+    lock.unlock();
+    std::exception_ptr jobError;
+    try {
+      Span span{"savefile", "async"};
+      job();
+    } catch (...) {
+      jobError = std::current_exception();
+    }
+    lock.lock();
+    if (jobError && !error) { error = jobError; }
+    queue.pop_front();
+    cv.notify_all();
+  }
+}
+
 void Saver::scan(u32 upToK) {
+  wait();
   lastK = 0;
   minValPRP = {};
   
@@ -101,6 +154,7 @@ void Saver::scan(u32 upToK) {
 
 void Saver::deleteBadSavefiles(u32 kBad, u32 currentK) {
   assert(kBad <= currentK);
+  wait();
   vector<u32> iterations = listIterations();
   for (u32 k : iterations) {
     if (k >= kBad && k <= currentK) {
@@ -136,23 +190,25 @@ vector<u32> makeVect(u32 size, u32 elem0) {
   return v;
 }
 
+fs::path tmpPath(const fs::path& path) { return path.string() + ".tmp"; }
+
 }
 
 // --- PRP ---
 
 PRPState Saver::loadPRP(u32 iniBlockSize) {
+  wait();
   if (lastK == 0) {
     log("PRP starting from beginning\n");
     u32 blockSize = iniBlockSize ? iniBlockSize : 400;
     return {0, blockSize, 3, makeVect(nWords(E), 1), 0};
   } else {
-    return loadPRPAux(lastK);
+    return loadPRPAux(lastK, pathPRP(lastK));
   }
 }
 
-PRPState Saver::loadPRPAux(u32 k) {
+PRPState Saver::loadPRPAux(u32 k, const fs::path& path) {
   assert(k > 0);
-  fs::path path = pathPRP(k);
   File fi = File::openReadThrow(path);
   string header = fi.readLine();
 
@@ -174,27 +230,35 @@ PRPState Saver::loadPRPAux(u32 k) {
   return {k, blockSize, res64, check, nErrors};
 }
 
-void Saver::savePRP(const PRPState& state) {
+void Saver::savePRP(PRPState&& state) {
   assert(state.check.size() == nWords(E));
   u32 k = state.k;
-  
-  fs::path path = pathPRP(k);
-  {
-    File fo = File::openWrite(path);
 
-    if (fo.printf(PRP_v12, E, k, state.blockSize, state.res64, state.nErrors, crc32(state.check)) <= 0) {
-      throw(ios_base::failure("can't write header"));
-    }    
-    fo.write(state.check);
-  }
-  loadPRPAux(k);
-  savedPRP(k);
+  submit(k, [this, state = std::move(state)]() {
+    fs::path path = pathPRP(state.k);
+    fs::path tmp = tmpPath(path);
+    {
+      File fo = File::openWrite(tmp);
+
+      if (fo.printf(PRP_v12, E, state.k, state.blockSize, state.res64, state.nErrors, crc32(state.check)) <= 0) {
+        throw(ios_base::failure("can't write header"));
+      }
+      fo.write(state.check);
+    }
+    loadPRPAux(state.k, tmp);
+    fs::rename(tmp, path);
+    savedPRP(state.k);
+  });
 }
 
 // --- P1 ---
 
 P1State Saver::loadP1(u32 k) {
-  fs::path path = pathP1(k);
+  wait();
+  return loadP1Aux(k, pathP1(k));
+}
+
+P1State Saver::loadP1Aux(u32 k, const fs::path& path) {
   File fi = File::openReadThrow(path);
   string header = fi.readLine();
   u32 fileE, fileB1, fileK, nextK, crc;
@@ -207,27 +271,34 @@ P1State Saver::loadP1(u32 k) {
   return {nextK, fi.readWithCRC<u32>(nWords(E), crc)};
 }
 
-void Saver::saveP1(u32 k, const P1State& state) {
-  auto& [nextK, data] = state;
-
-  assert(data.size() == nWords(E));
-  assert(nextK == 0 || nextK >= k);
-
-  {
-    File fo = File::openWrite(pathP1(k));
-    if (fo.printf(P1_v2, E, b1, k, nextK, crc32(data)) <= 0) {
-      throw(ios_base::failure("can't write header"));
+void Saver::saveP1(u32 k, P1State&& state) {
+  assert(state.second.size() == nWords(E));
+  assert(state.first == 0 || state.first >= k);
+
+  submit(k, [this, k, state = std::move(state)]() {
+    auto& [nextK, data] = state;
+    fs::path path = pathP1(k);
+    fs::path tmp = tmpPath(path);
+    {
+      File fo = File::openWrite(tmp);
+      if (fo.printf(P1_v2, E, b1, k, nextK, crc32(data)) <= 0) {
+        throw(ios_base::failure("can't write header"));
+      }
+      fo.write(data);
     }
-    fo.write(data);
-  }
-
-  loadP1(k);
+    loadP1Aux(k, tmp);
+    fs::rename(tmp, path);
+  });
 }
 
 // --- P1Final ---
 
 vector<u32> Saver::loadP1Final() {
-  fs::path path = pathP1Final();
+  wait();
+  return loadP1FinalAux(pathP1Final());
+}
+
+vector<u32> Saver::loadP1FinalAux(const fs::path& path) {
   File fi = File::openReadThrow(path);
   string header = fi.readLine();
   u32 fileE, fileB1, crc;
@@ -240,22 +311,29 @@ vector<u32> Saver::loadP1Final() {
   return fi.readWithCRC<u32>(nWords(E), crc);
 }
 
-void Saver::saveP1Final(const vector<u32>& data) {
+// Queued at the iteration of the last P1 savefile, so it waits only for the savefiles before that one.
+void Saver::saveP1Final(u32 k, vector<u32>&& data) {
   assert(data.size() == nWords(E));
-  {
-    File fo = File::openWrite(pathP1Final());
-    if (fo.printf(P1Final_v1, E, b1, crc32(data)) <= 0) {
-      throw(ios_base::failure("can't write header"));
-    }
-    fo.write(data);
-  }
 
-  loadP1Final();
+  submit(k, [this, data = std::move(data)]() {
+    fs::path path = pathP1Final();
+    fs::path tmp = tmpPath(path);
+    {
+      File fo = File::openWrite(tmp);
+      if (fo.printf(P1Final_v1, E, b1, crc32(data)) <= 0) {
+        throw(ios_base::failure("can't write header"));
+      }
+      fo.write(data);
+    }
+    loadP1FinalAux(tmp);
+    fs::rename(tmp, path);
+  });
 }
 
 // --- P2 ---
 
 u32 Saver::loadP2(u32 b2, u32 D, u32 nBuf) {
+  wait();
   fs::path path = pathP2();
   File fi = File::openRead(path);
   if (!fi) {
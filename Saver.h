@@ -9,6 +9,12 @@
 #include <string>
 #include <cinttypes>
 #include <queue>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
 
 class Args;
 
@@ -75,7 +81,9 @@ class Saver {
 
   void savedPRP(u32 k);
 
-  PRPState loadPRPAux(u32 k);
+  PRPState loadPRPAux(u32 k, const fs::path& path);
+  P1State loadP1Aux(u32 k, const fs::path& path);
+  vector<u32> loadP1FinalAux(const fs::path& path);
   vector<u32> listIterations(const string& prefix, const string& ext);
   vector<u32> listIterations();
   void scan(u32 upToK = u32(-1));
@@ -83,6 +91,21 @@ class Saver {
   const u32 E;
   const fs::path base = fs::current_path() / to_string(E);
   const u32 nKeep;
+
+  // The savefiles are written by a background thread: to a temporary file which is synced, read back,
+  // and renamed into place. A save at iteration k only waits for the ones at earlier iterations to land.
+  std::mutex mut;
+  std::condition_variable cv;
+  std::deque<pair<u32, std::function<void()>>> queue; // the front one is being written
+  std::exception_ptr error;
+  bool stop = false;
+  std::thread writer;
+
+  void submit(u32 k, std::function<void()>&& job);
+  void run();
+
+  // Waits for the queued savefiles to land; rethrows the error of a failed one.
+  void wait();
   
 public:
   const u32 b1;
@@ -90,16 +113,19 @@ public:
   
   Saver(u32 E, u32 nKeep, u32 b1, u32 startFrom);
 
+  ~Saver();
+
   static void cleanup(u32 E, const Args& args);
 
   PRPState loadPRP(u32 iniBlockSize);  
-  void savePRP(const PRPState& state);
+  void savePRP(PRPState&& state);
 
   P1State loadP1(u32 k);
-  void saveP1(u32 k, const P1State& state);
+  void saveP1(u32 k, P1State&& state);
 
   vector<u32> loadP1Final();
-  void saveP1Final(const vector<u32>& data);
+  // Written at the iteration "k" of the last P1 savefile.
+  void saveP1Final(u32 k, vector<u32>&& data);
   
   u32 loadP2(u32 b2, u32 D, u32 nBuf);
   void saveP2(u32 b2, u32 D, u32 nBuf, u32 nextBlock);
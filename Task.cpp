@@ -121,7 +121,7 @@ void Task::writeResultPM1(const Args& args, const string& factor, u32 fftSize) c
               });
 }
 
-void Task::adjustBounds(Args& args) {
+void Task::adjustBounds(const Args& args) {
   if (kind == PRP && wantsPm1) {
     if (B1 == 0 && args.B1) { B1 = args.B1; }
     if (B2 == 0 && args.B2) { B2 = args.B2; }
@@ -146,19 +146,19 @@ void Task::adjustBounds(Args& args) {
   }
 }
 
-void Task::execute(const Args& args) {
+void Task::execute(const Args& args, GpuSession& session) {
   LogContext pushContext(std::to_string(exponent));
   
   if (kind == VERIFY) {
     Proof proof = Proof::load(verifyPath);
-    auto gpu = Gpu::make(proof.E, args);
-    bool ok = proof.verify(gpu.get());
+    Gpu* gpu = Gpu::make(proof.E, session);
+    bool ok = proof.verify(gpu);
     log("proof '%s' %s\n", verifyPath.c_str(), ok ? "verified" : "failed");
     return;
   }
 
   assert(kind == PRP);
-  auto gpu = Gpu::make(exponent, args);
+  Gpu* gpu = Gpu::make(exponent, session);
   auto fftSize = gpu->getFFTSize();
 
   if (kind == PRP) {
@@ -12,6 +12,7 @@
 class Args;
 class Result;
 class Background;
+class GpuSession;
 
 struct Task {
   enum Kind {PRP, VERIFY};
@@ -29,9 +30,9 @@ struct Task {
 
   string verifyPath; // For Verify
   
-  void adjustBounds(Args& args);
+  void adjustBounds(const Args& args);
   
-  void execute(const Args& args);
+  void execute(const Args& args, GpuSession& session);
 
   void writeResultPRP(const Args&, bool isPrime, u64 res64, u32 fftSize, u32 nErrors, const fs::path& proofPath) const;
   void writeResultPM1(const Args&, const std::string& factor, u32 fftSize) const;
@@ -0,0 +1,88 @@
+// Copyright (C) Mihai Preda.
+
+#include "Trace.h"
+#include "File.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace trace {
+
+namespace {
+
+constexpr const u32 GPU_TID = 0;
+
+std::mutex mut;
+std::atomic<bool> on{false};
+std::unique_ptr<File> file;
+std::map<std::thread::id, u32> tids;
+
+// Must be called with the lock held.
+u32 tidOf(std::thread::id id) {
+  auto it = tids.find(id);
+  if (it != tids.end()) { return it->second; }
+  u32 tid = tids.size() + 1;
+  tids[id] = tid;
+  file->printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"host %u\"}},\n", tid, tid);
+  return tid;
+}
+
+// Must be called with the lock held.
+void write(const char* name, const char* cat, u64 begin, u64 end, u32 tid) {
+  file->printf("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ",\"pid\":1,\"tid\":%u},\n",
+               name, cat, begin, end > begin ? end - begin : 0, tid);
+}
+
+}
+
+void start(const fs::path& path) {
+  stop();
+  std::unique_lock lock{mut};
+  try {
+    file = std::make_unique<File>(File::openWrite(path));
+  } catch (const fs::filesystem_error&) {
+    log("can't write trace '%s'\n", path.string().c_str());
+    return;
+  }
+  tids.clear();
+  file->printf("[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}},\n", GPU_TID);
+  on = true;
+  log("tracing to '%s'\n", path.string().c_str());
+}
+
+void stop() {
+  std::unique_lock lock{mut};
+  if (!file) { return; }
+  on = false;
+  // A last event without the trailing comma, so that the file is valid JSON.
+  file->printf("{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%" PRIu64 ",\"pid\":1,\"tid\":%u}\n]\n", now(), GPU_TID);
+  file.reset();
+}
+
+bool enabled() { return on; }
+
+u64 now() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void complete(const char* name, const char* cat, u64 begin, u64 end) {
+  if (!on) { return; }
+  std::unique_lock lock{mut};
+  if (!file) { return; }
+  write(name, cat, begin, end, tidOf(std::this_thread::get_id()));
+}
+
+void gpu(const string& name, u64 begin, u64 end) {
+  if (!on) { return; }
+  std::unique_lock lock{mut};
+  if (!file) { return; }
+  write(name.c_str(), "kernel", begin, end, GPU_TID);
+}
+
+}
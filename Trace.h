@@ -0,0 +1,68 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Timeline of the host spans and the GPU kernels, written as a Chrome trace ("JSON Array Format", where the
+// closing bracket may be missing) that chrome://tracing and Perfetto open. Off unless started; when off,
+// recording is a single check of a flag.
+namespace trace {
+
+// Starts a new file, ending the previous one if any.
+void start(const fs::path& file);
+void stop();
+bool enabled();
+
+// Microseconds on the steady clock.
+u64 now();
+
+// A span on the calling thread.
+void complete(const char* name, const char* cat, u64 begin, u64 end);
+
+// A span on the GPU track.
+void gpu(const string& name, u64 begin, u64 end);
+
+}
+
+// The trace of a run segment; ends the file when going out of scope.
+class TraceFile {
+  bool active = false;
+
+public:
+  TraceFile() = default;
+  ~TraceFile() { if (active) { trace::stop(); } }
+
+  TraceFile(const TraceFile&) = delete;
+  TraceFile& operator=(const TraceFile&) = delete;
+
+  void start(const fs::path& file) {
+    trace::start(file);
+    active = true;
+  }
+
+  void stop() {
+    if (active) { trace::stop(); }
+    active = false;
+  }
+
+  explicit operator bool() const { return active; }
+};
+
+// Records a host span over its lifetime.
+class Span {
+  const char* name;
+  const char* cat;
+  u64 begin;
+
+public:
+  explicit Span(const char* name, const char* cat = "host") : name{name}, cat{cat}, begin{trace::enabled() ? trace::now() : 0} {}
+  ~Span() { if (begin) { trace::complete(name, cat, begin, trace::now()); } }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+};
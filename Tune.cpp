@@ -0,0 +1,65 @@
+// Copyright (C) Mihai Preda.
+
+#include "Tune.h"
+#include "File.h"
+
+string Variant::flagsString() const {
+  string s;
+  for (const string& flag : flags) { s += (s.empty() ? "" : ",") + flag; }
+  return s.empty() ? "-" : s;
+}
+
+namespace {
+
+vector<string> splitFlags(const string& s) {
+  vector<string> ret;
+  if (s == "-") { return ret; }
+  size_t start = 0;
+  while (true) {
+    size_t end = s.find(',', start);
+    ret.push_back(s.substr(start, end - start));
+    if (end == string::npos) { return ret; }
+    start = end + 1;
+  }
+}
+
+}
+
+TuneTable::TuneTable(const fs::path& file) : file{file} {
+  if (file.empty()) { return; }
+  File fi = File::openRead(file);
+  if (!fi) { return; }
+  if (fi.readLine() != string(HEADER) + '\n') {
+    log("%s: ignoring, not '%s'\n", fi.name.c_str(), HEADER);
+    return;
+  }
+  for (const string& line : fi) {
+    u32 fftSize = 0;
+    char spec[64];
+    char flags[512];
+    if (sscanf(line.c_str(), "%u %63s %511s", &fftSize, spec, flags) != 3) {
+      log("%s: bad line '%s'\n", fi.name.c_str(), line.c_str());
+      continue;
+    }
+    best[fftSize] = {spec, splitFlags(flags)};
+  }
+  if (!best.empty()) { log("Using the tuning of %u FFT sizes from '%s'\n", u32(best.size()), fi.name.c_str()); }
+}
+
+void TuneTable::save() const {
+  if (file.empty()) { return; }
+  string text = string(HEADER) + '\n';
+  for (const auto& [fftSize, variant] : best) { text += to_string(fftSize) + ' ' + variant.spec + ' ' + variant.flagsString() + '\n'; }
+  // Via a tmp file, as the table may be shared by the instances of a -pool.
+  if (!File::replace(file, text)) { log("can't write '%s'\n", file.string().c_str()); }
+}
+
+const Variant* TuneTable::get(u32 fftSize) const {
+  auto it = best.find(fftSize);
+  return it == best.end() ? nullptr : &it->second;
+}
+
+void TuneTable::set(u32 fftSize, const Variant& variant) {
+  best[fftSize] = variant;
+  save();
+}
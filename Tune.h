@@ -0,0 +1,36 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A FFT config (width:middle:height) together with the extra -use flags to build its kernels with.
+struct Variant {
+  string spec;
+  vector<string> flags;
+
+  string flagsString() const; // comma separated, "-" if none
+};
+
+// The fastest variant found by -tune on this device, for each FFT size. Gpu::make() uses it unless -fft is given.
+class TuneTable {
+  static constexpr const char* HEADER = "gpuowl tune v1";
+
+  const fs::path file; // empty: not persisted
+  std::map<u32, Variant> best;
+
+  void save() const;
+
+public:
+  explicit TuneTable(const fs::path& file);
+
+  // nullptr if the size was not tuned.
+  const Variant* get(u32 fftSize) const;
+  void set(u32 fftSize, const Variant& variant);
+};
@@ -13,7 +13,7 @@
 
 namespace {
 
-std::optional<Task> parse(const std::string& line) {
+std::optional<Task> parse(const std::string& line, bool verbose = true) {
   u32 exp = 0;
 
   u32 bitLo = 0;
@@ -48,7 +48,7 @@ std::optional<Task> parse(const std::string& line) {
       }
     }
   }
-  log("worktodo.txt line ignored: \"%s\"\n", rstripNewline(line).c_str());
+  if (verbose) { log("worktodo.txt line ignored: \"%s\"\n", rstripNewline(line).c_str()); }
   return std::nullopt;
 }
 
@@ -88,6 +88,15 @@ std::optional<Task> firstGoodTask(const fs::path& fileName) {
   return nullopt;
 }
 
+// Like firstGoodTask() but skipping "skipLine", and without logging the bad lines.
+std::optional<Task> peekTask(const fs::path& fileName, const std::string& skipLine) {
+  for (const string& line : File::openRead(fileName)) {
+    if (line == skipLine) { continue; }
+    if (optional<Task> maybeTask = parse(line, false)) { return maybeTask; }
+  }
+  return nullopt;
+}
+
 }
 
 std::optional<Task> Worktodo::getTask(Args &args) {
@@ -112,6 +121,14 @@ std::optional<Task> Worktodo::getTask(Args &args) {
   return std::nullopt;
 }
 
+std::optional<Task> Worktodo::peekNext(const Args& args, const Task& current) {
+  string worktodoTxt = "worktodo.txt";
+  optional<Task> task = peekTask(worktodoTxt, current.line);
+  if (!task && !args.masterDir.empty()) { task = peekTask(args.masterDir / worktodoTxt, current.line); }
+  if (task) { task->adjustBounds(args); }
+  return task;
+}
+
 bool Worktodo::deleteTask(const Task &task) {
   // Some tasks don't originate in worktodo.txt and thus don't need deleting.
   if (task.line.empty()) { return true; }
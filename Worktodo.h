@@ -12,6 +12,9 @@ class Worktodo {
 public:
   static std::optional<Task> getTask(Args &args);
   static bool deleteTask(const Task &task);
+
+  // The task that would follow "current", without taking it from the pool.
+  static std::optional<Task> peekNext(const Args& args, const Task& current);
   
   static Task makePRP(Args &args, u32 exponent) {
     Task task{Task::PRP, exponent};
@@ -11,6 +11,7 @@
 #include <new>
 #include <memory>
 #include <vector>
+#include <array>
 
 using namespace std;
 
@@ -132,6 +133,12 @@ static string getHwName(cl_device_id id) {
   return name;
 }
 
+string getDriverVersion(cl_device_id id) {
+  char version[256] = {0};
+  GET_INFO(id, CL_DRIVER_VERSION, version);
+  return version;
+}
+
 
 #define CL_DEVICE_VENDOR_ID 0x1001
 bool isAmdGpu(cl_device_id id) {
@@ -165,6 +172,18 @@ static string getFreq(cl_device_id device) {
 */
 
 string getShortInfo(cl_device_id device) { return getHwName(device); }
+
+u32 getComputeUnits(cl_device_id device) {
+  u32 computeUnits = 0;
+  GET_INFO(device, CL_DEVICE_MAX_COMPUTE_UNITS, computeUnits);
+  return computeUnits;
+}
+
+u32 getMaxClockMHz(cl_device_id device) {
+  u32 frequency = 0;
+  GET_INFO(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, frequency);
+  return frequency;
+}
 string getLongInfo(cl_device_id device) { return getShortInfo(device) + "-" + getBoardName(device); }
 
 cl_device_id getDevice(u32 argsDeviceId) {
@@ -247,7 +266,10 @@ static void build(cl_program program, cl_device_id device, string args) {
 }
 
 cl_program loadBinary(cl_context context, cl_device_id id, const string &fileName) {
-  string bytes = File::openRead(fileName).readAll();
+  return fromBinary(context, id, File::openReadThrow(fileName).readAll());
+}
+
+cl_program fromBinary(cl_context context, cl_device_id id, const string& bytes) {
   size_t size = bytes.size();
   const unsigned char *ptr = reinterpret_cast<const unsigned char *>(bytes.c_str());
   int err = 0;
@@ -258,15 +280,18 @@ cl_program loadBinary(cl_context context, cl_device_id id, const string &fileNam
   return program;
 }
 
-cl_program compile(cl_context context, cl_device_id device, const string &source, const string &extraArgs,
-                   const vector<string> &defines) {
+string buildArgs(const string& extraArgs, const vector<string>& defines) {
   string strDefines;
   for (const string& d : defines) { strDefines += "-D" + d + ' '; }
   
   // Note: Gpu.cpp also sets -cl-unfasafe-math-optimizations unless -safeMath is specified.
-  string args = strDefines + extraArgs + " -cl-std=CL2.0 -cl-finite-math-only ";
-
   // -cl-fast-relaxed-math  -cl-unsafe-math-optimizations -cl-denorms-are-zero -cl-mad-enable 
+  return strDefines + extraArgs + " -cl-std=CL2.0 -cl-finite-math-only ";
+}
+
+cl_program compile(cl_context context, cl_device_id device, const string &source, const string &extraArgs,
+                   const vector<string> &defines) {
+  string args = buildArgs(extraArgs, defines);
   log("OpenCL args \"%s\"\n", args.c_str());
   
   cl_program program = 0;
@@ -369,11 +394,16 @@ u32 getEventInfo(cl_event event) {
   return status;
 }
 
-u64 getEventNanos(cl_event event) {  
+std::pair<u64, u64> getEventStartEnd(cl_event event) {
   u64 start = 0;
   u64 end = 0;
   CHECK1(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, 0));
   CHECK1(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, 0));
+  return {start, end};
+}
+
+u64 getEventNanos(cl_event event) {
+  auto [start, end] = getEventStartEnd(event);
   return end - start;
 }
 
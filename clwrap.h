@@ -9,6 +9,7 @@
 #include <vector>
 #include <cassert>
 #include <memory>
+#include <utility>
 #include <any>
 
 using cl_queue = cl_command_queue;
@@ -53,7 +54,10 @@ void check(int err, const char *file, int line, const char *func, string_view me
 
 vector<cl_device_id> getAllDeviceIDs();
 string getShortInfo(cl_device_id device);
+u32 getComputeUnits(cl_device_id device);
+u32 getMaxClockMHz(cl_device_id device);
 string getLongInfo(cl_device_id device);
+string getDriverVersion(cl_device_id device);
 
 // Get GPU free memory in bytes.
 u64 getFreeMem(cl_device_id id);
@@ -62,10 +66,14 @@ bool isAmdGpu(cl_device_id id);
 
 cl_context createContext(cl_device_id id);
 
+// The complete compiler options string used by compile().
+string buildArgs(const string& extraArgs, const std::vector<string>& defines);
+
 cl_program compile(cl_context context, cl_device_id device, const string &source, const string &extraArgs,
                    const std::vector<string>& defines);
 
 cl_program loadBinary(cl_context, cl_device_id, const string& fileName);
+cl_program fromBinary(cl_context, cl_device_id, const string& bytes);
 
 string getBinary(cl_program program);
 
@@ -98,6 +106,9 @@ std::string getKernelArgName(cl_kernel k, int pos);
 
 cl_device_id getDevice(u32 argsDevId);
 u64 getEventNanos(cl_event event);
+
+// The device timestamps, in ns, of the start and end of the command.
+std::pair<u64, u64> getEventStartEnd(cl_event event);
 u32 getEventInfo(cl_event event);
 
 cl_context getQueueContext(cl_command_queue q);
@@ -26,7 +26,9 @@ TRIG_COMPUTE=<n> (default 2), can be used to balance between compute and memory
 and TRIG_COMPUTE=1 is in between.
 
 DEBUG      enable asserts. Slow, but allows to verify that all asserts hold.
-STATS      enable stats about roundoff distribution and carry magnitude
+STATS      enable stats about roundoff distribution and carry magnitude, reported at every log step
+HOST_PACK  convert the residues between FFT words and compact bits on the host instead of in the pack/unpack kernels
+NO_SPECULATE  wait for the result of each Gerbicz check instead of squaring ahead while it is evaluated
 
 ---- P-1 below ----
 
@@ -40,7 +42,7 @@ HAS_ASM : set if we believe __asm() can be used
  */
 
 /* List of code-specific macros. These are set by the C++ host code or derived
-EXP        the exponent
+WORD_BITS  the number of bits of a small word, i.e. exponent / NWORDS
 WIDTH
 SMALL_HEIGHT
 MIDDLE
@@ -111,8 +113,8 @@ G_H        "group height"
 #define UNROLL_WIDTH 1
 #endif
 
-// Expected defines: EXP the exponent.
-// WIDTH, SMALL_HEIGHT, MIDDLE.
+// Expected defines: WORD_BITS, WIDTH, SMALL_HEIGHT, MIDDLE.
+// The exponent itself is not compiled in; the values that depend on it are set at runtime by writeGlobals.
 
 #define BIG_HEIGHT (SMALL_HEIGHT * MIDDLE)
 #define ND (WIDTH * BIG_HEIGHT)
@@ -477,10 +479,7 @@ OVERLOAD TT mul(TT a, TT b) { return U2(mad1(RE(a), RE(b), - IM(a) * IM(b)), mad
 
 bool test(u32 bits, u32 pos) { return (bits >> pos) & 1; }
 
-#define STEP (NWORDS - (EXP % NWORDS))
-// bool isBigWord(u32 extra) { return extra < NWORDS - STEP; }
-
-u32 bitlen(bool b) { return EXP / NWORDS + b; }
+u32 bitlen(bool b) { return WORD_BITS + b; }
 
 
 // complex add * 2
@@ -716,7 +715,7 @@ Word OVERLOAD carryStep(i64 x, i32 *outCarry, bool isBigWord, bool exactness) {
   Word w = (exactness == MUST_BE_EXACT) ? lowBits(x, nBits) : ulowBits(x, nBits);
 // If nBits could 20 or more we must be careful.  doubleToLong generated x as 13 bits of trash and 51-bit signed value.
 // If we right shift 20 bits we will shift some of the trash into outCarry.  First we must remove the trash bits.
-#if EXP / NWORDS >= 19
+#if WORD_BITS >= 19
   *outCarry = as_int2(x << 13).y >> (nBits - 19);
 #else
   *outCarry = xtract32(x, nBits);
@@ -2125,6 +2124,14 @@ global double2 TRIG_W[WIDTH / 2 + 1];
 TT THREAD_WEIGHTS[G_W];
 TT CARRY_WEIGHTS[BIG_HEIGHT / CARRY_LEN];
 
+// The weight steps depend on the exponent.
+T WEIGHT_STEP;
+T IWEIGHT_STEP;
+T FWEIGHTS[CARRY_LEN];
+T IWEIGHTS[CARRY_LEN];
+T FWEIGHT_STEPS[NW];
+T IWEIGHT_STEPS[NW];
+
 double2 tableTrig(u32 k, u32 n, u32 kBound, global double2* trigTable) {
   assert(n % 8 == 0);
   assert(k < kBound);       // kBound actually bounds k
@@ -2206,8 +2213,7 @@ float fastCosSP(u32 k, u32 tau) {
 #define KERNEL(x) kernel __attribute__((reqd_work_group_size(x, 1, 1))) void
 
 KERNEL(64) writeGlobals(global double2* trig2ShDP, global double2* trigBhDP, global double2* trigNDP,
-                        global double2* trigW,
-                        global double2* threadWeights, global double2* carryWeights
+                        global double2* trigW
                         ) {
 #if SP
   for (u32 k = get_global_id(0); k < 2 * SMALL_HEIGHT/8 + 1; k += get_global_size(0)) { SP_TRIG_2SH[k] = trig2ShSP[k]; }
@@ -2223,10 +2229,29 @@ KERNEL(64) writeGlobals(global double2* trig2ShDP, global double2* trigBhDP, glo
 #elif TRIG_COMPUTE == 1
   for (u32 k = get_global_id(0); k <= WIDTH/2; k += get_global_size(0)) { TRIG_W[k] = trigW[k]; }
 #endif
+}
 
-  // Weights
+// The weights depend on the exponent, and are rewritten when the program is reused for a new exponent.
+KERNEL(64) writeWeights(global double2* threadWeights, global double2* carryWeights,
+                        double weightStep, double iweightStep,
+                        global double* fWeights, global double* iWeights,
+                        global double* fWeightSteps, global double* iWeightSteps
+                        ) {
   for (u32 k = get_global_id(0); k < G_W; k += get_global_size(0)) { THREAD_WEIGHTS[k] = threadWeights[k]; }
   for (u32 k = get_global_id(0); k < BIG_HEIGHT / CARRY_LEN; k += get_global_size(0)) { CARRY_WEIGHTS[k] = carryWeights[k]; }  
+
+  if (get_global_id(0) == 0) {
+    WEIGHT_STEP = weightStep;
+    IWEIGHT_STEP = iweightStep;
+  }
+  for (u32 k = get_global_id(0); k < CARRY_LEN; k += get_global_size(0)) {
+    FWEIGHTS[k] = fWeights[k];
+    IWEIGHTS[k] = iWeights[k];
+  }
+  for (u32 k = get_global_id(0); k < NW; k += get_global_size(0)) {
+    FWEIGHT_STEPS[k] = fWeightSteps[k];
+    IWEIGHT_STEPS[k] = iWeightSteps[k];
+  }
 }
 
 double2 slowTrig_2SH(u32 k, u32 kBound) { return tableTrig(k, 2 * SMALL_HEIGHT, kBound, TRIG_2SH); }
@@ -2354,6 +2379,116 @@ KERNEL(256) isNotZero(P(bool) outNotZero, u32 sizeBytes, global i64 *in) {
   }
 }
 
+// ---- Conversion between the balanced FFT words and the compact (unsigned, packed) residue ----
+
+// Words handled by one thread of packLast and packDigits; a group of 256 threads covers PACK_BLOCK words.
+#define PACK_WORDS 8
+#define PACK_BLOCK (256 * PACK_WORDS)
+
+// Index, in a Word buffer in the FFT (transposed) layout, of the sequential word "k".
+u32 wordPos(u32 k) {
+  u32 d = k / 2;
+  return (WIDTH * (d % BIG_HEIGHT) + d / BIG_HEIGHT) * 2 + k % 2;
+}
+
+// The offset of the first bit of word "k", ceil(E * k / NWORDS).
+u32 bitPos(u32 E, u32 k) { return (u32) (((u64) E * k + (NWORDS - 1)) / NWORDS); }
+
+// Unbalancing a word needs the borrow from the words below. A non-zero word determines the borrow out of it
+// (-1 if negative, 0 if positive) while a zero word propagates it. The borrow into a word is thus given by the closest
+// non-zero word below, which we find with a max-scan over "codes" (2*k + isNegative, or -1 for zero).
+// The borrow out of the top word wraps around into word 0, as 2^E == 1 mod M.
+
+// Per block of PACK_BLOCK words, the code of its last non-zero word.
+KERNEL(256) packLast(P(i32) blockCodes, CP(Word) in) {
+  u32 me = get_local_id(0);
+  u32 k0 = get_global_id(0) * PACK_WORDS;
+  i32 code = -1;
+  for (u32 i = 0; i < PACK_WORDS; ++i) {
+    Word w = in[wordPos(k0 + i)];
+    if (w) { code = 2 * (k0 + i) + (w < 0); }
+  }
+  code = work_group_reduce_max(code);
+  if (me == 0) { blockCodes[get_group_id(0)] = code; }
+}
+
+// Single group: the borrow into each block.
+KERNEL(256) packScan(P(i32) blockBorrow, CP(i32) blockCodes, u32 nBlocks) {
+  u32 me = get_local_id(0);
+  i32 top = -1;
+  for (u32 g = me; g < nBlocks; g += 256) { top = max(top, blockCodes[g]); }
+  top = work_group_reduce_max(top);
+  i32 wrapBorrow = (top >= 0) ? -(top & 1) : 0;
+
+  i32 below = -1;
+  for (u32 base = 0; base < nBlocks; base += 256) {
+    u32 g = base + me;
+    i32 code = (g < nBlocks) ? blockCodes[g] : -1;
+    i32 before = max(below, work_group_scan_exclusive_max(code));
+    if (g < nBlocks) { blockBorrow[g] = (before >= 0) ? -(before & 1) : wrapBorrow; }
+    below = max(below, work_group_reduce_max(code));
+  }
+}
+
+// The unsigned digit of each word, in sequential order.
+KERNEL(256) packDigits(P(u32) digits, CP(i32) blockBorrow, CP(Word) in, u32 E) {
+  u32 k0 = get_global_id(0) * PACK_WORDS;
+  Word w[PACK_WORDS];
+  i32 code = -1;
+  for (u32 i = 0; i < PACK_WORDS; ++i) {
+    w[i] = in[wordPos(k0 + i)];
+    if (w[i]) { code = 2 * (k0 + i) + (w[i] < 0); }
+  }
+  i32 before = work_group_scan_exclusive_max(code);
+  i32 borrow = (before >= 0) ? -(before & 1) : blockBorrow[get_group_id(0)];
+
+  u32 p = bitPos(E, k0);
+  for (u32 i = 0; i < PACK_WORDS; ++i) {
+    u32 pNext = bitPos(E, k0 + i + 1);
+    i32 x = w[i] + borrow;
+    borrow = (x < 0) ? -1 : 0;
+    digits[k0 + i] = (x < 0) ? x + (1 << (pNext - p)) : x;
+    p = pNext;
+  }
+}
+
+// One thread per output u32; the threads past the end write 0 (used as padding by sum64).
+KERNEL(256) packBits(P(u32) out, CP(u32) digits, u32 E) {
+  u32 j = get_global_id(0);
+  u32 nOut = (E - 1) / 32 + 1;
+  if (j >= nOut) {
+    out[j] = 0;
+    return;
+  }
+
+  u32 bitStart = j * 32;
+  u32 word = 0;
+  // The first digit overlapping bitStart.
+  for (u32 k = (u32) ((u64) bitStart * NWORDS / E); k < NWORDS; ++k) {
+    u32 p = bitPos(E, k);
+    if (p >= bitStart + 32) { break; }
+    word |= (p >= bitStart) ? (digits[k] << (p - bitStart)) : (digits[k] >> (bitStart - p));
+  }
+  out[j] = word;
+}
+
+// From compact bits to balanced words, one thread per word. The word's bits are read as signed; a set top bit
+// borrows 1 from the word above (wrapping around from the top word to word 0).
+KERNEL(256) unpackBits(P(Word) out, CP(u32) in, u32 E) {
+  u32 k = get_global_id(0);
+  u32 nIn = (E - 1) / 32 + 1;
+  u32 p = bitPos(E, k);
+  u32 len = bitPos(E, k + 1) - p;
+  u32 lo = in[p / 32];
+  u32 hi = (p / 32 + 1 < nIn) ? in[p / 32 + 1] : 0;
+  u32 bits = (u32) ((((u64) hi << 32) | lo) >> (p % 32)) & ((1u << len) - 1);
+  i32 w = ((i32) (bits << (32 - len))) >> (32 - len);
+
+  u32 topBelow = (k ? p : E) - 1;
+  w += (in[topBelow / 32] >> (topBelow % 32)) & 1;
+  out[wordPos(k)] = w;
+}
+
 void fft_WIDTH(local T2 *lds, T2 *u, Trig trig) {
 #if WIDTH == 256
   fft256w(lds, u, trig);
@@ -2455,69 +2590,11 @@ KERNEL(G_H) fftHout(P(T2) io, Trig smallTrig) {
   write(G_H, NH, u, io, 0);
 }
 
-T fweightStep(u32 i) {
-  const T TWO_TO_NTH[8] = {
-#if SP
-    // 2^(k/8) for k in [0..8)
-    (1,0,0),
-    (1.09050775,-1.30775399e-08,-2.52512433e-16),
-    (1.18920708,3.79763527e-08,1.15004321e-15),
-    (1.29683959,-4.01899953e-08,1.57969474e-15),
-    (1.41421354,2.4203235e-08,-7.62806744e-16),
-    (1.54221082,8.07090483e-09,-1.42546261e-16),
-    (1.68179286,-2.47553267e-08,-5.84143725e-16),
-    (1.8340081,-1.1239278e-08,-1.89213528e-16),
-#else
-    // 2^(k/8) -1 for k in [0..8)
-    0,
-    0.090507732665257662,
-    0.18920711500272105,
-    0.29683955465100964,
-    0.41421356237309503,
-    0.54221082540794086,
-    0.68179283050742912,
-    0.83400808640934243,
-#endif
-  };
-  return TWO_TO_NTH[i * STEP % NW * (8 / NW)];
-}
-
-T iweightStep(u32 i) {
-  const T TWO_TO_MINUS_NTH[8] = {
-#if SP
-    // 2^-(k/8) for k in [0..8)
-    (1,0,0),
-    (0.917004049,-5.61963898e-09,-9.46067642e-17),
-    (0.840896428,-1.23776633e-08,-2.92071863e-16),
-    (0.771105409,4.03545242e-09,-7.12731307e-17),
-    (0.707106769,1.21016175e-08,-3.81403372e-16),
-    (0.648419797,-2.00949977e-08,7.89847371e-16),
-    (0.594603539,1.89881764e-08,5.75021604e-16),
-    (0.545253873,-6.53876997e-09,-1.26256216e-16)
-#else
-    // 2^-(k/8) - 1 for k in [0..8)
-    0,
-    -0.082995956795328771,
-    -0.15910358474628547,
-    -0.2288945872960296,
-    -0.29289321881345248,
-    -0.35158022267449518,
-    -0.40539644249863949,
-    -0.45474613366737116,
-#endif
-  };
-  return TWO_TO_MINUS_NTH[i * STEP % NW * (8 / NW)];
-}
+T fweightStep(u32 i) { return FWEIGHT_STEPS[i]; }
+T iweightStep(u32 i) { return IWEIGHT_STEPS[i]; }
 
-T fweightUnitStep(u32 i) {
-  T FWEIGHTS_[] = FWEIGHTS;
-  return FWEIGHTS_[i];
-}
-
-T iweightUnitStep(u32 i) {
-  T IWEIGHTS_[] = IWEIGHTS;
-  return IWEIGHTS_[i];
-}
+T fweightUnitStep(u32 i) { return FWEIGHTS[i]; }
+T iweightUnitStep(u32 i) { return IWEIGHTS[i]; }
 
 // fftPremul: weight words with IBDWT weights followed by FFT-width.
 KERNEL(G_W) fftP(P(T2) out, CP(Word2) in, Trig smallTrig) {
@@ -2874,14 +2951,31 @@ KERNEL(OUT_WG) fftMiddleOut(P(T2) out, P(T2) in, Trig trig) {
   for (i32 i = 0; i < MIDDLE; ++i) { out[i * (OUT_WG * OUT_SPACING)] = u[i]; }
 }
 
+// Log-scaled histogram of the per-iteration max roundoff: 16 bins per octave (the exponent and the top 4 mantissa
+// bits of the float) starting at 2^-8. Must match the host's ROUNDOFF_BINS, ROUNDOFF_BIN0.
+#define ROUNDOFF_BINS 128
+#define ROUNDOFF_BIN0 (119 << 4)
+
+void roundStats(float err, global u32* roundOut) {
+  atomic_max(&roundOut[3], as_uint(err));
+  ulong fix = (ulong) (err * 4294967296.0f);
+  atom_add((global ulong *) &roundOut[4], fix);
+  atom_add((global ulong *) &roundOut[6], (fix * fix) >> 32);
+  int bin = clamp((int) (as_uint(err) >> 19) - ROUNDOFF_BIN0, 0, ROUNDOFF_BINS - 1);
+  atomic_inc(&roundOut[8 + bin]);
+}
+
 void updateStats(float roundMax, u32 carryMax, global u32* roundOut, global u32* carryStats) {
   roundMax = work_group_reduce_max(roundMax);
   carryMax = work_group_reduce_max(carryMax);
   if (get_local_id(0) == 0) {
-    // Roundout 0   = count(iteration)
-    // Roundout 1   = max(workgroup maxerr)
-    // Roundout 2   = count(workgroup)
-    // Roundout 8.. = vector of iteration_maxerr
+    // Roundout 0    = count(iteration)
+    // Roundout 1    = max(workgroup maxerr)
+    // Roundout 2    = count(workgroup)
+    // Roundout 3    = max(iteration_maxerr)
+    // Roundout 4..5 = sum(iteration_maxerr * 2^32), ulong
+    // Roundout 6..7 = sum(iteration_maxerr^2 * 2^32), ulong
+    // Roundout 8..  = histogram of iteration_maxerr
 
     atomic_max(&roundOut[1], as_uint(roundMax));
     atomic_max(&carryStats[4], carryMax);
@@ -2891,8 +2985,8 @@ void updateStats(float roundMax, u32 carryMax, global u32* roundOut, global u32*
       u32 roundTmp = atomic_xchg(&roundOut[1], 0);
       carryMax = atomic_xchg(&carryStats[4], 0);
       roundOut[2] = 0;
-      int nPrevIt = atomic_inc(&roundOut[0]);
-      if (nPrevIt < 1024 * 1024) { roundOut[8 + nPrevIt] = roundTmp; }
+      atomic_inc(&roundOut[0]);
+      roundStats(as_float(roundTmp), roundOut);
       
       atom_add((global ulong *) &carryStats[0], carryMax);
       atomic_max(&carryStats[2], carryMax);
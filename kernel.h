@@ -9,6 +9,24 @@
 
 #include <string>
 #include <stdexcept>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+// The estimated memory traffic and floating point work of one launch, used to report the achieved rates.
+struct KernelCost {
+  double bytesRead{};
+  double bytesWritten{};
+  double flops{};
+
+  double bytes() const { return bytesRead + bytesWritten; }
+};
+
+// A buffer argument: the cl_mem to set, and the buffer id to tell whether it is already set.
+struct BufferArg {
+  cl_mem mem;
+  u64 id;
+};
 
 class Kernel {
   KernelHolder kernel;
@@ -16,6 +34,8 @@ class Kernel {
   QueuePtr queue;
   size_t workSize;
   string name;
+  vector<string> bound; // the arguments last set (the bytes, or the id of a buffer), to skip setting them again
+  KernelCost cost;
 
 public:
   Kernel(cl_program program, QueuePtr queue, cl_device_id device, u32 nWorkGroups, const std::string &name) :
@@ -44,24 +64,79 @@ public:
     run();
   }
 
+  // Sets the arguments without launching.
+  template<typename... Args> void bind(const Args &...args) { setArgs(0, args...); }
+
+  // Launches with the arguments already set.
+  void run() {
+    if (kernel) {
+      queue->run(kernel.get(), groupSize, workSize, name);
+    } else {
+      throw std::runtime_error("OpenCL kernel "s + name + " not found");
+    }
+  }
+
+  // Forgets the arguments set, so that they are all set again by the next call.
+  void unbind() { bound.clear(); }
+
   string getName() { return name; }
 
+  void setCost(const KernelCost& c) { cost = c; }
+  const KernelCost& getCost() const { return cost; }
+
 private:
-  template<typename T> void setArgs(int pos, const ConstBuffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const Buffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const HostAccessBuffer<T>& buf) { setArgs(pos, buf.get()); }
-  template<typename T> void setArgs(int pos, const T &arg) { ::setArg(kernel.get(), pos, arg); }
+  template<typename T> void setArgs(int pos, const ConstBuffer<T>& buf) { setArgs(pos, BufferArg{buf.get(), buf.id()}); }
+  template<typename T> void setArgs(int pos, const Buffer<T>& buf) { setArgs(pos, BufferArg{buf.get(), buf.id()}); }
+  template<typename T> void setArgs(int pos, const HostAccessBuffer<T>& buf) { setArgs(pos, BufferArg{buf.get(), buf.id()}); }
+
+  // Buffers are told apart by their id, as the driver may give a released buffer's cl_mem to a new allocation.
+  // The 'b' keeps the key distinct from the bytes of a scalar.
+  void setArgs(int pos, const BufferArg& buf) {
+    string key = 'b' + string{reinterpret_cast<const char*>(&buf.id), sizeof(buf.id)};
+    if (pos >= int(bound.size())) { bound.resize(pos + 1); }
+    if (bound[pos] != key) {
+      ::setArg(kernel.get(), pos, buf.mem);
+      bound[pos] = std::move(key);
+    }
+  }
+  
+  template<typename T> void setArgs(int pos, const T &arg) {
+    string bytes{reinterpret_cast<const char*>(&arg), sizeof(arg)};
+    if (pos >= int(bound.size())) { bound.resize(pos + 1); }
+    if (bound[pos] != bytes) {
+      ::setArg(kernel.get(), pos, arg);
+      bound[pos] = std::move(bytes);
+    }
+  }
   
   template<typename T, typename... Args> void setArgs(int pos, const T &arg, const Args &...tail) {
     setArgs(pos, arg);
     setArgs(pos + 1, tail...);
   }
-  
-  void run() {
-    if (kernel) {
-      queue->run(kernel.get(), groupSize, workSize, name);
-    } else {
-      throw std::runtime_error("OpenCL kernel "s + name + " not found");
+};
+
+// A recorded sequence of kernel launches, replayed many times with the arguments bound once per run() instead of
+// once per launch. A kernel holds a single set of arguments, so it should appear only once in a sequence.
+class KernelSequence {
+  vector<std::pair<Kernel*, std::function<void()>>> steps;
+
+  template<typename T> static BufferArg raw(const ConstBuffer<T>& buf) { return {buf.get(), buf.id()}; }
+  template<typename T> static BufferArg raw(const Buffer<T>& buf) { return {buf.get(), buf.id()}; }
+  template<typename T> static BufferArg raw(const HostAccessBuffer<T>& buf) { return {buf.get(), buf.id()}; }
+  template<typename T> static const T& raw(const T& arg) { return arg; }
+
+public:
+  template<typename... Args> void add(Kernel& kernel, const Args &...args) {
+    steps.emplace_back(&kernel, [&kernel, values = std::make_tuple(raw(args)...)]() {
+      std::apply([&kernel](const auto &...v) { kernel.bind(v...); }, values);
+    });
+  }
+
+  void run(u32 times) {
+    if (!times) { return; }
+    for (auto& [kernel, bind] : steps) { bind(); }
+    for (u32 i = 0; i < times; ++i) {
+      for (auto& [kernel, bind] : steps) { kernel->run(); }
     }
   }
 };
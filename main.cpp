@@ -2,6 +2,7 @@
 
 #include "Args.h"
 #include "Task.h"
+#include "Gpu.h"
 #include "Worktodo.h"
 #include "common.h"
 #include "File.h"
@@ -69,13 +70,23 @@ int main(int argc, char **argv) {
     if (!args.cpu.empty()) { globalCpuName = args.cpu; }
     
     if (args.maxAlloc) { AllocTrac::setMaxAlloc(args.maxAlloc); }
+
+    GpuSession session{args};
     
     if (args.prpExp) {
-      Worktodo::makePRP(args, args.prpExp).execute(args);
+      Worktodo::makePRP(args, args.prpExp).execute(args, session);
+    } else if (args.benchHostExp) {
+      Gpu::make(args.benchHostExp, session)->benchHost(20'000);
+    } else if (!args.calibrate.empty()) {
+      session.calibrate(args.calibrate);
+    } else if (args.tuneExp) {
+      session.tune(args.tuneExp);
+    } else if (!args.bench.empty()) {
+      session.bench(args.bench);
     } else if (!args.verifyPath.empty()) {
-      Worktodo::makeVerify(args, args.verifyPath).execute(args);
+      Worktodo::makeVerify(args, args.verifyPath).execute(args, session);
     } else {
-      while (auto task = Worktodo::getTask(args)) { task->execute(args); }
+      while (auto task = Worktodo::getTask(args)) { task->execute(args, session); }
     }
   } catch (const char *mes) {
     log("Exiting because \"%s\"\n", mes);
@@ -0,0 +1,130 @@
+// Microbenchmark of compactBits()/expandBits() against the previous serial implementation.
+
+#include "state.h"
+#include "timeutil.h"
+
+#include <cstdio>
+#include <random>
+#include <cassert>
+
+namespace {
+
+// The previous implementation, as reference.
+u32 bitlen(u32 N, u32 E, u32 k) { return E / N + isBigWord(N, E, k); }
+
+int lowBits(int u, int bits) { return (u << (32 - bits)) >> (32 - bits); }
+
+u32 unbalance(int w, int nBits, int *carry) {
+  w += *carry;
+  *carry = 0;
+  if (w < 0) {
+    w += (1 << nBits);
+    *carry = -1;
+  }
+  return w;
+}
+
+vector<u32> refCompactBits(const vector<int> &data, u32 E) {
+  std::vector<u32> out;
+  out.reserve((E - 1) / 32 + 1);
+  u32 N = data.size();
+  int carry = 0;
+  u32 outWord = 0;
+  int haveBits = 0;
+
+  for (u32 p = 0; p < N; ++p) {
+    int nBits = bitlen(N, E, p);
+    u32 w = unbalance(data[p], nBits, &carry);
+    int topBits = 32 - haveBits;
+    outWord |= w << haveBits;
+    if (nBits >= topBits) {
+      out.push_back(outWord);
+      outWord = w >> topBits;
+      haveBits = nBits - topBits;
+    } else {
+      haveBits += nBits;
+    }
+  }
+  out.push_back(outWord);
+
+  for (int p = 0; carry; ++p) {
+    i64 v = i64(out[p]) + carry;
+    out[p] = v & 0xffffffff;
+    carry = v >> 32;
+  }
+  return out;
+}
+
+vector<int> refExpandBits(const vector<u32> &compactBits, u32 N, u32 E) {
+  std::vector<int> out(N);
+  u64 bits = 0;
+  u32 size = 0;
+  auto it = compactBits.cbegin();
+  for (u32 p = 0; p < N; ++p) {
+    u32 len = bitlen(N, E, p);
+    if (size < len) {
+      bits += u64(*it++) << size;
+      size += 32;
+    }
+    int b = lowBits(bits, len);
+    size -= len;
+    bits >>= len;
+    bits += (b < 0);
+    out[p] = b;
+  }
+  out[0] += bits;
+  return out;
+}
+
+// Random balanced words, as they come out of the carry kernels.
+vector<int> randomWords(u32 N, u32 E, std::mt19937& rng) {
+  vector<int> data(N);
+  for (u32 k = 0; k < N; ++k) {
+    u32 len = bitlen(N, E, k);
+    data[k] = int(rng() & ((1u << len) - 1)) - (1 << (len - 1));
+  }
+  return data;
+}
+
+template<typename F>
+double secsPerCall(F f) {
+  Timer timer;
+  u32 n = 0;
+  do {
+    f();
+    ++n;
+  } while (timer.elapsedSecs() < 1);
+  return timer.elapsedSecs() / n;
+}
+
+}
+
+int main(int argc, char** argv) {
+  initLog();
+  std::mt19937 rng(2021);
+
+  printf("%6s %10s | %12s %12s | %12s %12s  (Mwords/s)\n", "FFT", "exponent", "compact ref", "compact", "expand ref", "expand");
+  for (u32 N : {5u << 20, 6u << 20, 8u << 20, 10u << 20, 12u << 20, 16u << 20, 18u << 20}) {
+    u32 E = u32(N * 17.3) | 1;
+    vector<int> data = randomWords(N, E, rng);
+
+    vector<u32> compact = compactBits(data, E);
+    if (compact != refCompactBits(data, E)) {
+      printf("compactBits mismatch at N=%u\n", N);
+      return 1;
+    }
+
+    // The expanded words may differ from the reference but must have the same value.
+    if (compactBits(expandBits(compact, N, E), E) != compact || refCompactBits(refExpandBits(compact, N, E), E) != compact) {
+      printf("expandBits mismatch at N=%u\n", N);
+      return 1;
+    }
+
+    double mega = N / 1e6;
+    printf("%5uM %10u | %12.1f %12.1f | %12.1f %12.1f\n", N >> 20, E,
+           mega / secsPerCall([&]() { refCompactBits(data, E); }),
+           mega / secsPerCall([&]() { compactBits(data, E); }),
+           mega / secsPerCall([&]() { refExpandBits(compact, N, E); }),
+           mega / secsPerCall([&]() { expandBits(compact, N, E); }));
+  }
+}
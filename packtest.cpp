@@ -0,0 +1,122 @@
+// Round-trip check of compactBits()/expandBits(), run by the build (see Makefile).
+
+#include "state.h"
+
+#include <cstdio>
+#include <random>
+
+namespace {
+
+u32 bitlen(u32 N, u32 E, u32 k) { return E / N + isBigWord(N, E, k); }
+
+// The bit offset of word "k".
+u32 bitPos(u32 N, u32 E, u32 k) { return (u64(E) * k + (N - 1)) / N; }
+
+// The E-bit value with all the bits set, except "clear"; as compactBits() writes it.
+vector<u32> onesExcept(u32 E, u32 clear) {
+  vector<u32> v((E - 1) / 32 + 1, ~0u);
+  if (E % 32) { v.back() = (1u << (E % 32)) - 1; }
+  v[clear / 32] &= ~(1u << (clear % 32));
+  return v;
+}
+
+// Random E-bit values, excluding 2^E - 1 which is a second representation of 0.
+vector<u32> randomCompact(u32 E, std::mt19937& rng) {
+  vector<u32> v((E - 1) / 32 + 1);
+  for (u32& w : v) { w = rng(); }
+  if (E % 32) { v.back() &= (1u << (E % 32)) - 1; }
+  v[0] &= ~1u;
+  return v;
+}
+
+// Balanced words, each within [-2^(len-1), 2^(len-1)), as they come out of the carry kernels.
+vector<int> randomWords(u32 N, u32 E, std::mt19937& rng) {
+  vector<int> data(N);
+  for (u32 k = 0; k < N; ++k) {
+    u32 len = bitlen(N, E, k);
+    data[k] = int(rng() & ((1u << len) - 1)) - (1 << (len - 1));
+  }
+  return data;
+}
+
+vector<int> extremeWords(u32 N, u32 E, bool top) {
+  vector<int> data(N);
+  for (u32 k = 0; k < N; ++k) {
+    u32 len = bitlen(N, E, k);
+    data[k] = top ? (1 << (len - 1)) - 1 : -(1 << (len - 1));
+  }
+  return data;
+}
+
+bool isBalanced(const vector<int>& data, u32 N, u32 E) {
+  for (u32 k = 0; k < N; ++k) {
+    i64 half = i64(1) << (bitlen(N, E, k) - 1);
+    // expandBits() may add 1 to a word, and the final carry to word 0.
+    if (data[k] < -half || data[k] > half + (k == 0)) { return false; }
+  }
+  return true;
+}
+
+int nFail = 0;
+
+void expect(bool ok, const char* what, u32 N, u32 E) {
+  if (!ok) {
+    printf("packtest: %s failed, N=%u E=%u\n", what, N, E);
+    ++nFail;
+  }
+}
+
+void check(u32 N, u32 E, std::mt19937& rng) {
+  for (int i = 0; i < 4; ++i) {
+    vector<u32> compact = randomCompact(E, rng);
+    vector<int> words = expandBits(compact, N, E);
+    expect(isBalanced(words, N, E), "expand balanced", N, E);
+    expect(compactBits(words, E) == compact, "compact(expand(x)) == x", N, E);
+
+    vector<int> data = randomWords(N, E, rng);
+    vector<u32> packed = compactBits(data, E);
+    expect(compactBits(expandBits(packed, N, E), E) == packed, "compact(expand(compact(w))) == compact(w)", N, E);
+  }
+
+  // The borrow of a negative word 0 runs through all the words and wraps around from the top.
+  vector<int> data(N);
+  data[0] = -1;
+  expect(compactBits(data, E) == onesExcept(E, 0), "borrow from word 0", N, E);
+
+  // A negative top word borrows from the wrap-around, into word 0.
+  data[0] = 0;
+  data[N - 1] = -1;
+  expect(compactBits(data, E) == onesExcept(E, bitPos(N, E, N - 1)), "borrow from the top word", N, E);
+
+  for (bool top : {false, true}) {
+    vector<u32> packed = compactBits(extremeWords(N, E, top), E);
+    expect(compactBits(expandBits(packed, N, E), E) == packed, top ? "max words" : "min words", N, E);
+  }
+
+  // The largest value, with the top word's bits all set.
+  vector<u32> compact = onesExcept(E, 0);
+  expect(compactBits(expandBits(compact, N, E), E) == compact, "top bits set", N, E);
+}
+
+}
+
+int main() {
+  initLog();
+  std::mt19937 rng(2021);
+
+  // The small sizes run serially, the large ones are split in chunks over the threads.
+  for (u32 N : {256u, 1u << 12, 3u << 12, 1u << 20, 5u << 20}) {
+    for (double bpw : {17.3, 18.9}) {
+      u32 E = u32(N * bpw) | 1;
+      check(N, E, rng);
+    }
+  }
+  // An exponent that is a multiple of 32 bits plus one, so the top word holds a single bit.
+  check(1u << 12, 32 * 2212 + 1, rng);
+
+  if (nFail) {
+    printf("packtest: %d failures\n", nFail);
+    return 1;
+  }
+  printf("packtest: OK\n");
+}
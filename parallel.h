@@ -0,0 +1,28 @@
+// Copyright (C) Mihai Preda.
+
+#pragma once
+
+#include "common.h"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+// Calls f(begin, end) on disjoint chunks covering [0, n), concurrently on up to one thread per core.
+// Ranges shorter than 2 * minChunk are run on the calling thread.
+template<typename F>
+void parallelFor(u32 n, F f, u32 minChunk = 1024) {
+  u32 nThreads = std::max(1u, std::min(std::thread::hardware_concurrency(), n / std::max(minChunk, 1u)));
+  if (nThreads <= 1) {
+    f(0u, n);
+    return;
+  }
+
+  u32 chunk = (n - 1) / nThreads + 1;
+  vector<std::future<void>> futures;
+  for (u32 begin = chunk; begin < n; begin += chunk) {
+    futures.push_back(std::async(std::launch::async, f, begin, std::min(begin + chunk, n)));
+  }
+  f(0u, std::min(chunk, n));
+  for (auto& future : futures) { future.get(); }
+}
@@ -2,110 +2,155 @@
 
 #include "state.h"
 #include "shared.h"
+#include "parallel.h"
 
 #include <cassert>
 #include <memory>
 #include <cmath>
+#include <algorithm>
+#include <thread>
 
 static u32 bitlen(u32 N, u32 E, u32 k) { return E / N + isBigWord(N, E, k); }
 
 static int lowBits(int u, int bits) { return (u << (32 - bits)) >> (32 - bits); }
 
-static u32 unbalance(int w, int nBits, int *carry) {
-  assert(*carry == 0 || *carry == -1);
-  w += *carry;
-  *carry = 0;
-  if (w < 0) {
-    w += (1 << nBits);
-    *carry = -1;
+namespace {
+
+// Words per thread below which compactBits/expandBits don't split the work.
+constexpr u32 MIN_CHUNK = 1 << 18;
+
+// The bit offset of word "k", ceil(E * k / N).
+u32 bitPos(u32 N, u32 E, u32 k) { return (u64(E) * k + (N - 1)) / N; }
+
+// Walks the word lengths from "k" on, without the per-word modulo of isBigWord().
+class WordLen {
+  const u32 N, step, smallLen;
+  u32 extra;
+
+public:
+  WordLen(u32 N, u32 E, u32 k) : N{N}, step{::step(N, E)}, smallLen{E / N}, extra{::extra(N, E, k)} {}
+
+  // The length of the current word, and advance to the next one.
+  u32 next() {
+    u32 len = smallLen + (extra < N - step);
+    extra += step;
+    extra -= (extra >= N) ? N : 0;
+    return len;
   }
-  if (!(0 <= w && w < (1 << nBits))) { log("w=%d, nBits=%d\n", w, nBits); }
-  assert(0 <= w && w < (1 << nBits));
-  return w;
+};
+
+// Unbalances and packs the words [begin, end) into "out", with "borrow" (0 or -1) into word "begin".
+// The first output word is shared with the previous chunk unless it starts on a word boundary;
+// in that case it is returned instead of written.
+u32 packChunk(const int* data, u32 N, u32 E, u32 begin, u32 end, int borrow, u32* out) {
+  u32 pos = bitPos(N, E, begin);
+  u32* p = out + pos / 32;
+  u32 have = pos % 32;
+  bool sharedHead = have != 0;
+  u32 head = 0;
+  u64 acc = 0;
+  
+  WordLen wordLen{N, E, begin};
+  for (u32 k = begin; k < end; ++k) {
+    u32 len = wordLen.next();
+    int x = data[k] + borrow;
+    borrow = x >> 31;
+    u32 digit = x + (borrow & (1 << len));
+    assert(digit < (1u << len));
+    acc |= u64(digit) << have;
+    have += len;
+    if (have >= 32) {
+      if (sharedHead) {
+        head = u32(acc);
+        sharedHead = false;
+        ++p;
+      } else {
+        *p++ = u32(acc);
+      }
+      acc >>= 32;
+      have -= 32;
+    }
+  }
+  
+  // The partial last word; the next chunk's head is or-ed into it.
+  if (have) {
+    if (sharedHead) {
+      head = u32(acc);
+    } else {
+      *p = u32(acc);
+    }
+  }
+  return head;
 }
 
-std::vector<u32> compactBits(const vector<int> &dataVect, u32 E) {
-  std::vector<u32> out;
-  out.reserve((E - 1) / 32 + 1);
+}
 
+// The words are split in one chunk per thread. The borrow into a chunk is determined by the last non-zero word
+// below it (a zero word propagates the borrow), so it is resolved up front and the chunks are then packed independently.
+// The borrow out of the top word wraps around into word 0, as 2^E == 1 mod M.
+std::vector<u32> compactBits(const vector<int> &dataVect, u32 E) {
   u32 N = dataVect.size();
   const int *data = dataVect.data();
-
-  int carry = 0;
-  u32 outWord = 0;
-  int haveBits = 0;
-
-  for (u32 p = 0; p < N; ++p) {
-    int nBits = bitlen(N, E, p);
-    u32 w = unbalance(data[p], nBits, &carry);
-
-    assert(nBits > 0);
-    assert(w < (1u << nBits));
-
-    assert(haveBits < 32);
-    int topBits = 32 - haveBits;
-    outWord |= w << haveBits;
-    if (nBits >= topBits) {
-      out.push_back(outWord);
-      outWord = w >> topBits;
-      haveBits = nBits - topBits;
-    } else {
-      haveBits += nBits;
+  
+  u32 nChunks = std::max(1u, std::min(std::thread::hardware_concurrency(), N / MIN_CHUNK));
+  vector<u32> starts;
+  for (u32 i = 0; i <= nChunks; ++i) { starts.push_back(u64(N) * i / nChunks); }
+
+  // The borrow out of each chunk: -1, 0, or 1 if it is all zero (propagates).
+  vector<int> borrowOut(nChunks, 1);
+  for (u32 i = 0; i < nChunks; ++i) {
+    for (u32 k = starts[i + 1]; k > starts[i]; --k) {
+      if (data[k - 1]) {
+        borrowOut[i] = data[k - 1] < 0 ? -1 : 0;
+        break;
+      }
     }
   }
 
-  assert(haveBits);
-  out.push_back(outWord);
+  int topBorrow = 0;
+  for (int b : borrowOut) { if (b != 1) { topBorrow = b; } }
 
-  for (int p = 0; carry; ++p) {
-    i64 v = i64(out[p]) + carry;
-    out[p] = v & 0xffffffff;
-    carry = v >> 32;
-  }
+  vector<int> borrowIn(nChunks);
+  borrowIn[0] = topBorrow;
+  for (u32 i = 1; i < nChunks; ++i) { borrowIn[i] = (borrowOut[i - 1] == 1) ? borrowIn[i - 1] : borrowOut[i - 1]; }
 
-  assert(out.size() == (E - 1) / 32 + 1);
+  std::vector<u32> out((E - 1) / 32 + 1);
+  vector<u32> heads(nChunks);
+  parallelFor(nChunks, [&](u32 from, u32 to) {
+    for (u32 i = from; i < to; ++i) { heads[i] = packChunk(data, N, E, starts[i], starts[i + 1], borrowIn[i], out.data()); }
+  }, 1);
+  for (u32 i = 1; i < nChunks; ++i) { out[bitPos(N, E, starts[i]) / 32] |= heads[i]; }
   return out;
 }
 
-struct BitBucket {
-  u64 bits;
-  u32 size;
-
-  BitBucket() : bits(0), size(0) {}
-
-  void put32(u32 b) {
-    assert(size <= 32);
-    bits += (u64(b) << size);
-    size += 32;
-  }
-  
-  int popSigned(u32 n) {
-    assert(size >= n);
-    int b = lowBits(bits, n);
-    size -= n;
-    bits >>= n;
-    bits += (b < 0); // carry fixup.
-    return b;
-  }
-};
-
+// Each word is read as a signed field, plus 1 if the top bit of the field below is set (i.e. if that one was
+// read as negative). The top field's carry wraps around into word 0. Thus the words are independent of each other.
 vector<int> expandBits(const vector<u32> &compactBits, u32 N, u32 E) {
   assert(E % 32 != 0);
-
-  std::vector<int> out(N);
-  int *data = out.data();
-  BitBucket bucket;
+  assert(compactBits.size() == (E - 1) / 32 + 1);
+  const u32 *in = compactBits.data();
   
-  auto it = compactBits.cbegin(), itEnd = compactBits.cend();
-  for (u32 p = 0; p < N; ++p) {
-    u32 len = bitlen(N, E, p);    
-    if (bucket.size < len) { assert(it != itEnd); bucket.put32(*it++); }
-    data[p] = bucket.popSigned(len);
-  }
-  assert(it == itEnd);
-  assert(bucket.size == 32 - E % 32);
-  assert(bucket.bits == 0 || bucket.bits == 1);
-  data[0] += bucket.bits; // carry wrap-around.
+  std::vector<int> out(N);
+  parallelFor(N, [&](u32 from, u32 to) {
+    WordLen wordLen{N, E, from};
+    u32 p = bitPos(N, E, from);
+    u32 topBit = from ? (in[(p - 1) / 32] >> ((p - 1) % 32)) & 1 : (in[(E - 1) / 32] >> ((E - 1) % 32)) & 1;
+    const u32 *it = in + p / 32 + 1;
+    u64 bits = in[p / 32] >> (p % 32);
+    u32 size = 32 - p % 32;
+    for (u32 k = from; k < to; ++k) {
+      u32 len = wordLen.next();
+      if (size < len) {
+        bits |= u64(*it++) << size;
+        size += 32;
+      }
+      int w = lowBits(bits, len);
+      bits >>= len;
+      size -= len;
+      out[k] = w + topBit;
+      topBit = u32(w) >> 31;
+    }
+  }, MIN_CHUNK);
   return out;
 }
 